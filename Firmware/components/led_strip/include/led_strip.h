@@ -70,6 +70,25 @@ esp_err_t led_strip_set_pixel_rgbw(led_strip_handle_t strip, uint32_t index, uin
  */
 esp_err_t led_strip_set_pixel_hsv(led_strip_handle_t strip, uint32_t index, uint16_t hue, uint8_t saturation, uint8_t value);
 
+/**
+ * @brief Copy a run of pixels that are already in the strip's native GRB byte order
+ *
+ * @note This is the fast path for callers that keep their image data in wire order: on the RMT backend
+ *       it boils down to a single memcpy into the pixel buffer instead of one `led_strip_set_pixel` call per LED.
+ * @note For GRBW strips the white component of every pixel is set to zero.
+ *
+ * @param strip: LED strip
+ * @param start: index of the first pixel to set
+ * @param count: number of pixels to set
+ * @param buf: pixel data, 3 bytes (G, R, B) per pixel
+ *
+ * @return
+ *      - ESP_OK: Set pixels successfully
+ *      - ESP_ERR_INVALID_ARG: Set pixels failed because of invalid parameters
+ *      - ESP_FAIL: Set pixels failed because other error occurred
+ */
+esp_err_t led_strip_set_pixels(led_strip_handle_t strip, uint32_t start, uint32_t count, const uint8_t *buf);
+
 /**
  * @brief Refresh memory colors to LEDs
  *
@@ -84,6 +103,52 @@ esp_err_t led_strip_set_pixel_hsv(led_strip_handle_t strip, uint32_t index, uint
  */
 esp_err_t led_strip_refresh(led_strip_handle_t strip);
 
+/**
+ * @brief Start refreshing memory colors to LEDs without waiting for the transfer to finish
+ *
+ * @param strip: LED strip
+ *
+ * @return
+ *      - ESP_OK: Refresh started successfully
+ *      - ESP_FAIL: Refresh failed because some other error occurred
+ *
+ * @note:
+ *      For RMT strips created with `flags.double_buffer`, the pixels can be updated for the next frame right away,
+ *      the previous transfer is waited for on the next call. Otherwise `led_strip_wait_refresh_done` must be
+ *      called before the pixels are touched again. Backends that cannot refresh asynchronously block here.
+ */
+esp_err_t led_strip_refresh_async(led_strip_handle_t strip);
+
+/**
+ * @brief Wait for a refresh started by `led_strip_refresh_async` to finish
+ *
+ * @param strip: LED strip
+ *
+ * @return
+ *      - ESP_OK: Refresh finished successfully
+ *      - ESP_FAIL: Waiting failed because some other error occurred
+ */
+esp_err_t led_strip_wait_refresh_done(led_strip_handle_t strip);
+
+/**
+ * @brief Refresh several LED strips at once
+ *
+ * Starts the transfers of all strips back to back and only then waits for them to finish, so strips on
+ * separate channels go out on the wire in parallel instead of one after another.
+ *
+ * @param strips: array of LED strips, NULL entries are skipped
+ * @param num_strips: number of entries in `strips`
+ *
+ * @return
+ *      - ESP_OK: Refresh successfully
+ *      - ESP_ERR_INVALID_ARG: Refresh failed because of invalid argument
+ *      - ESP_FAIL: Refresh failed because some other error occurred
+ *
+ * @note:
+ *      All strips are refreshed even if one of them fails, the first error is returned.
+ */
+esp_err_t led_strip_refresh_multi(led_strip_handle_t *strips, size_t num_strips);
+
 /**
  * @brief Clear LED strip (turn off all LEDs)
  *
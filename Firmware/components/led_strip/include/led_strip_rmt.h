@@ -31,6 +31,8 @@ typedef struct {
     size_t mem_block_symbols;   /*!< How many RMT symbols can one RMT channel hold at one time. Set to 0 will fallback to use the default size. */
     struct {
         uint32_t with_dma: 1;   /*!< Use DMA to transmit data */
+        uint32_t double_buffer: 1; /*!< Keep the channel enabled and double-buffer the pixels, so that
+                                        `led_strip_refresh_async` returns as soon as the transfer is queued */
     } flags;                    /*!< Extra driver flags */
 } led_strip_rmt_config_t;
 
@@ -48,6 +50,21 @@ typedef struct {
  */
 esp_err_t led_strip_new_rmt_device(const led_strip_config_t *led_config, const led_strip_rmt_config_t *rmt_config, led_strip_handle_t *ret_strip);
 
+/**
+ * @brief Register a callback that is invoked whenever a refresh of the strip has gone out on the wire
+ *
+ * @note The callback runs in ISR context and must not block.
+ * @note Only valid for strips created by `led_strip_new_rmt_device`.
+ *
+ * @param strip LED strip
+ * @param cb Callback, or NULL to unregister
+ * @param user_ctx User data passed to the callback
+ * @return
+ *      - ESP_OK: register the callback successfully
+ *      - ESP_ERR_INVALID_ARG: register the callback failed because of invalid argument
+ */
+esp_err_t led_strip_rmt_register_refresh_done_callback(led_strip_handle_t strip, led_strip_refresh_done_cb_t cb, void *user_ctx);
+
 #ifdef __cplusplus
 }
 #endif
@@ -6,6 +6,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdbool.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -35,6 +36,15 @@ typedef enum {
  */
 typedef struct led_strip_t *led_strip_handle_t;
 
+/**
+ * @brief Callback invoked from ISR context when a refresh has been sent to the LEDs
+ *
+ * @param strip LED strip that finished refreshing
+ * @param user_ctx User data passed when registering the callback
+ * @return Whether a high priority task has been woken up by this callback
+ */
+typedef bool (*led_strip_refresh_done_cb_t)(led_strip_handle_t strip, void *user_ctx);
+
 /**
  * @brief LED Strip Configuration
  */
@@ -51,6 +51,21 @@ struct led_strip_t {
      */
     esp_err_t (*set_pixel_rgbw)(led_strip_t *strip, uint32_t index, uint32_t red, uint32_t green, uint32_t blue, uint32_t white);
 
+    /**
+     * @brief Copy a run of pixels that are already in the strip's native GRB byte order
+     *
+     * @param strip: LED strip
+     * @param start: index of the first pixel to set
+     * @param count: number of pixels to set
+     * @param buf: pixel data, 3 bytes (G, R, B) per pixel
+     *
+     * @return
+     *      - ESP_OK: Set pixels successfully
+     *      - ESP_ERR_INVALID_ARG: Set pixels failed because of invalid parameters
+     *      - ESP_FAIL: Set pixels failed because other error occurred
+     */
+    esp_err_t (*set_pixels)(led_strip_t *strip, uint32_t start, uint32_t count, const uint8_t *buf);
+
     /**
      * @brief Refresh memory colors to LEDs
      *
@@ -66,6 +81,30 @@ struct led_strip_t {
      */
     esp_err_t (*refresh)(led_strip_t *strip);
 
+    /**
+     * @brief Start flushing memory colors to LEDs without waiting for the transfer to finish
+     *
+     * @note Optional. Backends that leave this NULL are refreshed with the blocking `refresh` instead.
+     *
+     * @param strip: LED strip
+     *
+     * @return
+     *      - ESP_OK: Transfer started successfully
+     *      - ESP_FAIL: Transfer failed to start because some other error occurred
+     */
+    esp_err_t (*refresh_start)(led_strip_t *strip);
+
+    /**
+     * @brief Wait for a transfer started by `refresh_start` to finish
+     *
+     * @param strip: LED strip
+     *
+     * @return
+     *      - ESP_OK: Transfer finished successfully
+     *      - ESP_FAIL: Waiting failed because some other error occurred
+     */
+    esp_err_t (*refresh_wait)(led_strip_t *strip);
+
     /**
      * @brief Clear LED strip (turn off all LEDs)
      *
@@ -75,12 +75,83 @@ esp_err_t led_strip_set_pixel_rgbw(led_strip_handle_t strip, uint32_t index, uin
     return strip->set_pixel_rgbw(strip, index, red, green, blue, white);
 }
 
+esp_err_t led_strip_set_pixels(led_strip_handle_t strip, uint32_t start, uint32_t count, const uint8_t *buf)
+{
+    ESP_RETURN_ON_FALSE(strip && buf, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    if (strip->set_pixels) {
+        return strip->set_pixels(strip, start, count, buf);
+    }
+    // backends without a bulk path get the pixels one by one
+    for (uint32_t i = 0; i < count; i++, buf += 3) {
+        ESP_RETURN_ON_ERROR(strip->set_pixel(strip, start + i, buf[1], buf[0], buf[2]), TAG, "set pixel failed");
+    }
+    return ESP_OK;
+}
+
 esp_err_t led_strip_refresh(led_strip_handle_t strip)
 {
     ESP_RETURN_ON_FALSE(strip, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
     return strip->refresh(strip);
 }
 
+esp_err_t led_strip_refresh_async(led_strip_handle_t strip)
+{
+    ESP_RETURN_ON_FALSE(strip, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    if (strip->refresh_start) {
+        return strip->refresh_start(strip);
+    }
+    return strip->refresh(strip);
+}
+
+esp_err_t led_strip_wait_refresh_done(led_strip_handle_t strip)
+{
+    ESP_RETURN_ON_FALSE(strip, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    if (strip->refresh_wait) {
+        return strip->refresh_wait(strip);
+    }
+    return ESP_OK;
+}
+
+esp_err_t led_strip_refresh_multi(led_strip_handle_t *strips, size_t num_strips)
+{
+    ESP_RETURN_ON_FALSE(strips, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    ESP_RETURN_ON_FALSE(num_strips <= 32, ESP_ERR_INVALID_ARG, TAG, "too many strips");
+    esp_err_t ret = ESP_OK;
+    uint32_t started = 0; // bit mask of strips that have a transfer in flight
+
+    // kick off every transfer first ...
+    for (size_t i = 0; i < num_strips; i++) {
+        led_strip_t *strip = strips[i];
+        esp_err_t err;
+        if (!strip) {
+            continue;
+        }
+        if (strip->refresh_start) {
+            err = strip->refresh_start(strip);
+            if (err == ESP_OK) {
+                started |= 1UL << i;
+            }
+        } else {
+            err = strip->refresh(strip);
+        }
+        if (err != ESP_OK && ret == ESP_OK) {
+            ret = err;
+        }
+    }
+
+    // ... then wait for all of them together
+    for (size_t i = 0; i < num_strips; i++) {
+        if (started & (1UL << i)) {
+            esp_err_t err = strips[i]->refresh_wait(strips[i]);
+            if (err != ESP_OK && ret == ESP_OK) {
+                ret = err;
+            }
+        }
+    }
+
+    return ret;
+}
+
 esp_err_t led_strip_clear(led_strip_handle_t strip)
 {
     ESP_RETURN_ON_FALSE(strip, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
@@ -28,8 +28,12 @@ typedef struct {
     led_strip_t base;
     rmt_channel_handle_t rmt_chan;
     rmt_encoder_handle_t strip_encoder;
+    led_strip_refresh_done_cb_t done_cb;
+    void *done_cb_ctx;
     uint32_t strip_len;
     uint8_t bytes_per_pixel;
+    bool double_buffer;
+    uint8_t *pixels;   // the buffer the set_pixel functions write to
     uint8_t pixel_buf[];
 } led_strip_rmt_obj;
 
@@ -39,11 +43,11 @@ static esp_err_t led_strip_rmt_set_pixel(led_strip_t *strip, uint32_t index, uin
     ESP_RETURN_ON_FALSE(index < rmt_strip->strip_len, ESP_ERR_INVALID_ARG, TAG, "index out of maximum number of LEDs");
     uint32_t start = index * rmt_strip->bytes_per_pixel;
     // In thr order of GRB, as LED strip like WS2812 sends out pixels in this order
-    rmt_strip->pixel_buf[start + 0] = green & 0xFF;
-    rmt_strip->pixel_buf[start + 1] = red & 0xFF;
-    rmt_strip->pixel_buf[start + 2] = blue & 0xFF;
+    rmt_strip->pixels[start + 0] = green & 0xFF;
+    rmt_strip->pixels[start + 1] = red & 0xFF;
+    rmt_strip->pixels[start + 2] = blue & 0xFF;
     if (rmt_strip->bytes_per_pixel > 3) {
-        rmt_strip->pixel_buf[start + 3] = 0;
+        rmt_strip->pixels[start + 3] = 0;
     }
     return ESP_OK;
 }
@@ -53,7 +57,7 @@ static esp_err_t led_strip_rmt_set_pixel_rgbw(led_strip_t *strip, uint32_t index
     led_strip_rmt_obj *rmt_strip = __containerof(strip, led_strip_rmt_obj, base);
     ESP_RETURN_ON_FALSE(index < rmt_strip->strip_len, ESP_ERR_INVALID_ARG, TAG, "index out of maximum number of LEDs");
     ESP_RETURN_ON_FALSE(rmt_strip->bytes_per_pixel == 4, ESP_ERR_INVALID_ARG, TAG, "wrong LED pixel format, expected 4 bytes per pixel");
-    uint8_t *buf_start = rmt_strip->pixel_buf + index * 4;
+    uint8_t *buf_start = rmt_strip->pixels + index * 4;
     // SK6812 component order is GRBW
     *buf_start = green & 0xFF;
     *++buf_start = red & 0xFF;
@@ -62,38 +66,111 @@ static esp_err_t led_strip_rmt_set_pixel_rgbw(led_strip_t *strip, uint32_t index
     return ESP_OK;
 }
 
-static esp_err_t led_strip_rmt_refresh(led_strip_t *strip)
+static esp_err_t led_strip_rmt_set_pixels(led_strip_t *strip, uint32_t start, uint32_t count, const uint8_t *buf)
+{
+    led_strip_rmt_obj *rmt_strip = __containerof(strip, led_strip_rmt_obj, base);
+    ESP_RETURN_ON_FALSE(start + count <= rmt_strip->strip_len, ESP_ERR_INVALID_ARG, TAG, "index out of maximum number of LEDs");
+    uint8_t *dst = rmt_strip->pixels + start * rmt_strip->bytes_per_pixel;
+    if (rmt_strip->bytes_per_pixel == 3) {
+        // the caller's buffer is already in wire order
+        memcpy(dst, buf, count * 3);
+        return ESP_OK;
+    }
+    for (uint32_t i = 0; i < count; i++, buf += 3, dst += 4) {
+        dst[0] = buf[0];
+        dst[1] = buf[1];
+        dst[2] = buf[2];
+        dst[3] = 0;
+    }
+    return ESP_OK;
+}
+
+static bool led_strip_rmt_on_trans_done(rmt_channel_handle_t chan, const rmt_tx_done_event_data_t *edata, void *user_ctx)
+{
+    led_strip_rmt_obj *rmt_strip = (led_strip_rmt_obj *)user_ctx;
+    led_strip_refresh_done_cb_t cb = rmt_strip->done_cb;
+    if (cb) {
+        return cb(&rmt_strip->base, rmt_strip->done_cb_ctx);
+    }
+    return false;
+}
+
+static esp_err_t led_strip_rmt_refresh_start(led_strip_t *strip)
 {
     led_strip_rmt_obj *rmt_strip = __containerof(strip, led_strip_rmt_obj, base);
+    size_t size = rmt_strip->strip_len * rmt_strip->bytes_per_pixel;
     rmt_transmit_config_t tx_conf = {
         .loop_count = 0,
     };
 
+    if (rmt_strip->double_buffer) {
+        // The channel stays enabled. We only have to make sure the previous transfer is out of
+        // the buffer we are about to hand to the caller again.
+        ESP_RETURN_ON_ERROR(rmt_tx_wait_all_done(rmt_strip->rmt_chan, -1), TAG, "flush RMT channel failed");
+        uint8_t *tx_buf = rmt_strip->pixels;
+        ESP_RETURN_ON_ERROR(rmt_transmit(rmt_strip->rmt_chan, rmt_strip->strip_encoder, tx_buf, size, &tx_conf),
+                            TAG, "transmit pixels by RMT failed");
+        // Continue drawing on the other buffer, starting from the frame that is going out now
+        rmt_strip->pixels = (tx_buf == rmt_strip->pixel_buf) ? rmt_strip->pixel_buf + size : rmt_strip->pixel_buf;
+        memcpy(rmt_strip->pixels, tx_buf, size);
+        return ESP_OK;
+    }
+
     ESP_RETURN_ON_ERROR(rmt_enable(rmt_strip->rmt_chan), TAG, "enable RMT channel failed");
-    ESP_RETURN_ON_ERROR(rmt_transmit(rmt_strip->rmt_chan, rmt_strip->strip_encoder, rmt_strip->pixel_buf,
-                                     rmt_strip->strip_len * rmt_strip->bytes_per_pixel, &tx_conf), TAG, "transmit pixels by RMT failed");
+    esp_err_t ret = rmt_transmit(rmt_strip->rmt_chan, rmt_strip->strip_encoder, rmt_strip->pixels, size, &tx_conf);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "transmit pixels by RMT failed");
+        rmt_disable(rmt_strip->rmt_chan);
+    }
+    return ret;
+}
+
+static esp_err_t led_strip_rmt_refresh_wait(led_strip_t *strip)
+{
+    led_strip_rmt_obj *rmt_strip = __containerof(strip, led_strip_rmt_obj, base);
     ESP_RETURN_ON_ERROR(rmt_tx_wait_all_done(rmt_strip->rmt_chan, -1), TAG, "flush RMT channel failed");
-    ESP_RETURN_ON_ERROR(rmt_disable(rmt_strip->rmt_chan), TAG, "disable RMT channel failed");
+    if (!rmt_strip->double_buffer) {
+        ESP_RETURN_ON_ERROR(rmt_disable(rmt_strip->rmt_chan), TAG, "disable RMT channel failed");
+    }
     return ESP_OK;
 }
 
+static esp_err_t led_strip_rmt_refresh(led_strip_t *strip)
+{
+    ESP_RETURN_ON_ERROR(led_strip_rmt_refresh_start(strip), TAG, "start refresh failed");
+    return led_strip_rmt_refresh_wait(strip);
+}
+
 static esp_err_t led_strip_rmt_clear(led_strip_t *strip)
 {
     led_strip_rmt_obj *rmt_strip = __containerof(strip, led_strip_rmt_obj, base);
     // Write zero to turn off all leds
-    memset(rmt_strip->pixel_buf, 0, rmt_strip->strip_len * rmt_strip->bytes_per_pixel);
+    memset(rmt_strip->pixels, 0, rmt_strip->strip_len * rmt_strip->bytes_per_pixel);
     return led_strip_rmt_refresh(strip);
 }
 
 static esp_err_t led_strip_rmt_del(led_strip_t *strip)
 {
     led_strip_rmt_obj *rmt_strip = __containerof(strip, led_strip_rmt_obj, base);
+    if (rmt_strip->double_buffer) {
+        ESP_RETURN_ON_ERROR(rmt_tx_wait_all_done(rmt_strip->rmt_chan, -1), TAG, "flush RMT channel failed");
+        ESP_RETURN_ON_ERROR(rmt_disable(rmt_strip->rmt_chan), TAG, "disable RMT channel failed");
+    }
     ESP_RETURN_ON_ERROR(rmt_del_channel(rmt_strip->rmt_chan), TAG, "delete RMT channel failed");
     ESP_RETURN_ON_ERROR(rmt_del_encoder(rmt_strip->strip_encoder), TAG, "delete strip encoder failed");
     free(rmt_strip);
     return ESP_OK;
 }
 
+esp_err_t led_strip_rmt_register_refresh_done_callback(led_strip_handle_t strip, led_strip_refresh_done_cb_t cb, void *user_ctx)
+{
+    ESP_RETURN_ON_FALSE(strip, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    led_strip_rmt_obj *rmt_strip = __containerof(strip, led_strip_rmt_obj, base);
+    rmt_strip->done_cb_ctx = user_ctx;
+    rmt_strip->done_cb = cb;
+    return ESP_OK;
+}
+
 esp_err_t led_strip_new_rmt_device(const led_strip_config_t *led_config, const led_strip_rmt_config_t *rmt_config, led_strip_handle_t *ret_strip)
 {
     led_strip_rmt_obj *rmt_strip = NULL;
@@ -108,7 +185,8 @@ esp_err_t led_strip_new_rmt_device(const led_strip_config_t *led_config, const l
     } else {
         assert(false);
     }
-    rmt_strip = calloc(1, sizeof(led_strip_rmt_obj) + led_config->max_leds * bytes_per_pixel);
+    size_t num_buffers = rmt_config->flags.double_buffer ? 2 : 1;
+    rmt_strip = calloc(1, sizeof(led_strip_rmt_obj) + num_buffers * led_config->max_leds * bytes_per_pixel);
     ESP_GOTO_ON_FALSE(rmt_strip, ESP_ERR_NO_MEM, err, TAG, "no mem for rmt strip");
     uint32_t resolution = rmt_config->resolution_hz ? rmt_config->resolution_hz : LED_STRIP_RMT_DEFAULT_RESOLUTION;
 
@@ -139,12 +217,27 @@ esp_err_t led_strip_new_rmt_device(const led_strip_config_t *led_config, const l
     };
     ESP_GOTO_ON_ERROR(rmt_new_led_strip_encoder(&strip_encoder_conf, &rmt_strip->strip_encoder), err, TAG, "create LED strip encoder failed");
 
+    // callbacks can only be registered while the channel is still disabled
+    rmt_tx_event_callbacks_t cbs = {
+        .on_trans_done = led_strip_rmt_on_trans_done,
+    };
+    ESP_GOTO_ON_ERROR(rmt_tx_register_event_callbacks(rmt_strip->rmt_chan, &cbs, rmt_strip), err, TAG, "register RMT callbacks failed");
+
+    if (rmt_config->flags.double_buffer) {
+        // keep the channel enabled for the lifetime of the strip
+        ESP_GOTO_ON_ERROR(rmt_enable(rmt_strip->rmt_chan), err, TAG, "enable RMT channel failed");
+    }
 
     rmt_strip->bytes_per_pixel = bytes_per_pixel;
     rmt_strip->strip_len = led_config->max_leds;
+    rmt_strip->double_buffer = rmt_config->flags.double_buffer;
+    rmt_strip->pixels = rmt_strip->pixel_buf;
     rmt_strip->base.set_pixel = led_strip_rmt_set_pixel;
     rmt_strip->base.set_pixel_rgbw = led_strip_rmt_set_pixel_rgbw;
+    rmt_strip->base.set_pixels = led_strip_rmt_set_pixels;
     rmt_strip->base.refresh = led_strip_rmt_refresh;
+    rmt_strip->base.refresh_start = led_strip_rmt_refresh_start;
+    rmt_strip->base.refresh_wait = led_strip_rmt_refresh_wait;
     rmt_strip->base.clear = led_strip_rmt_clear;
     rmt_strip->base.del = led_strip_rmt_del;
 
@@ -152,6 +245,9 @@ esp_err_t led_strip_new_rmt_device(const led_strip_config_t *led_config, const l
     return ESP_OK;
 err:
     if (rmt_strip) {
+        if (rmt_strip->rmt_chan && rmt_config->flags.double_buffer) {
+            rmt_disable(rmt_strip->rmt_chan);
+        }
         if (rmt_strip->rmt_chan) {
             rmt_del_channel(rmt_strip->rmt_chan);
         }
@@ -0,0 +1,160 @@
+// Feeds the angle estimator with the edges of a wheel whose motion is
+// known exactly, and reports its angular error: just before each edge,
+// which is where the extrapolation is at its worst, and halfway between
+// edges. Also checks the speed and direction it ends up with. Fails if a
+// case gets worse than its limits.
+
+#include <math.h>
+#include <stdio.h>
+
+#include "angle-estimator.h"
+
+// Edges after a restart before the estimate is judged
+#define SETTLE_EDGES 8
+
+// The estimator takes a zero timestamp for "no edge yet", so its clock
+// runs this far ahead of the wheel's, in seconds
+#define CLOCK_OFFSET 1.0
+
+typedef struct {
+    const char *name;
+    double speed;         // at the start, in revolutions per second
+    double acceleration;  // in revolutions per second squared
+    double duration;      // in seconds
+    int sensors;          // evenly spaced
+    int direction_hint;   // what the estimator knows before the first edge
+
+    // Limits, in degrees and revolutions per second
+    float max_edge_error;
+    float max_mid_error;
+    float max_speed_error;
+} test_case;
+
+static const test_case cases[] = {
+    { "steady", 8, 0, 10, 4, 0, 0.05f, 0.05f, 0.01f },
+    { "fast", 25, 0, 5, 4, 0, 0.2f, 0.2f, 0.01f },
+    { "slow", 1.5, 0, 10, 4, 0, 0.05f, 0.05f, 0.01f },
+    // At 1 rev/s, the first judged edges still show the acceleration
+    // being picked up
+    { "spin up", 1, 2, 4, 4, 0, 8.0f, 5.0f, 0.05f },
+    { "braking", 10, -2, 4, 4, 0, 0.5f, 0.5f, 0.05f },
+    { "backwards", -5, 0, 10, 4, 0, 0.05f, 0.05f, 0.01f },
+    { "backwards braking", -10, 2, 4, 4, 0, 0.5f, 0.5f, 0.05f },
+    // Sensors half a revolution apart can't tell the direction from the
+    // first two edges, the hint from the last ride has to
+    { "two sensors forwards", 5, 0, 5, 2, 1, 0.05f, 0.05f, 0.01f },
+    { "two sensors backwards", -5, 0, 5, 2, -1, 0.05f, 0.05f, 0.01f },
+};
+
+#define CASE_COUNT (sizeof(cases) / sizeof(cases[0]))
+
+static double truth_at(const test_case *c, double t)
+{
+    return c->speed * t + 0.5 * c->acceleration * t * t;
+}
+
+// Sensor index of the wheel position, counting across revolutions
+static long sensor_at(const test_case *c, double t)
+{
+    return (long)floor(truth_at(c, t) * c->sensors);
+}
+
+// Time of the next edge after `from`, or a negative time if there is none
+// before the end
+static double next_edge(const test_case *c, double from)
+{
+    const double step = 10e-6;
+    long sensor = sensor_at(c, from);
+
+    for (double t = from + step; t < c->duration; t += step) {
+        if (sensor_at(c, t) == sensor)
+            continue;
+
+        // Narrow it down to where the wheel passes the sensor
+        double lo = t - step, hi = t;
+
+        while (hi - lo > 1e-9) {
+            double mid = 0.5 * (lo + hi);
+
+            if (sensor_at(c, mid) == sensor)
+                lo = mid;
+            else
+                hi = mid;
+        }
+
+        return hi;
+    }
+
+    return -1;
+}
+
+static float error_at(const test_case *c, const angle_estimator *estimator, double t)
+{
+    float truth = angle_estimator_normalize((float)fmod(truth_at(c, t), 1.0));
+    float estimate = angle_estimator_position_at(estimator, (int64_t)llround((t + CLOCK_OFFSET) * 1e6));
+
+    return fabsf(angle_estimator_wrap(estimate - truth)) * 360.0f;
+}
+
+static bool run_case(const test_case *c)
+{
+    angle_estimator_config config = ANGLE_ESTIMATOR_DEFAULT_CONFIG();
+    angle_estimator estimator;
+
+    angle_estimator_init(&estimator, &config);
+    estimator.direction_hint = c->direction_hint;
+
+    float edge_max = 0, mid_max = 0;
+    double edge_sum = 0, mid_sum = 0;
+    int edges = 0, judged = 0;
+    double last = -1;
+
+    for (double t = next_edge(c, 0); t > 0; t = next_edge(c, t)) {
+        double sensor_position = floor(truth_at(c, t) * c->sensors + 0.5) / c->sensors;
+        int64_t timestamp = (int64_t)llround((t + CLOCK_OFFSET) * 1e6);
+
+        if (estimator.edges >= SETTLE_EDGES) {
+            float edge_error = error_at(c, &estimator, t);
+            float mid_error = error_at(c, &estimator, 0.5 * (last + t));
+
+            edge_sum += edge_error;
+            mid_sum += mid_error;
+            if (edge_error > edge_max)
+                edge_max = edge_error;
+            if (mid_error > mid_max)
+                mid_max = mid_error;
+
+            judged++;
+        }
+
+        angle_estimator_update(&estimator, timestamp, angle_estimator_normalize((float)fmod(sensor_position, 1.0)));
+        last = t;
+        edges++;
+    }
+
+    double final_speed = c->speed + c->acceleration * last;
+    float speed_error = fabsf(estimator.velocity - (float)final_speed);
+    bool direction_ok = (estimator.velocity > 0) == (final_speed > 0);
+    bool ok = judged > 0 && direction_ok &&
+              edge_max <= c->max_edge_error && mid_max <= c->max_mid_error &&
+              speed_error <= c->max_speed_error;
+
+    printf("%-22s %6d %9.4f %9.4f %9.4f %9.4f %8.3f %8.3f  %s\n",
+           c->name, edges, edge_sum / judged, edge_max, mid_sum / judged, mid_max,
+           estimator.velocity, final_speed, ok ? "ok" : "FAIL");
+
+    return ok;
+}
+
+int main()
+{
+    bool ok = true;
+
+    printf("%-22s %6s %9s %9s %9s %9s %8s %8s\n",
+           "case", "edges", "edge avg", "edge max", "mid avg", "mid max", "rps", "true rps");
+
+    for (size_t i = 0; i < CASE_COUNT; i++)
+        ok &= run_case(&cases[i]);
+
+    return ok ? 0 : 1;
+}
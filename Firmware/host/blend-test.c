@@ -0,0 +1,115 @@
+// Checks blend_columns() against the formula in blend.h for every pixel
+// value and weight, and does the same for a model of the ESP32-S3 vector
+// lanes in blend_pie.S, which may be one below the formula. Then times the
+// portable implementation on the canvas' column size.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "blend.h"
+
+// One column of the strip, 32 LEDs of 3 bytes
+#define COLUMN_SIZE 96
+
+#define BENCHMARK_COLUMNS 2000000
+
+static int formula(int a, int b, int weight)
+{
+    return (a * (256 - weight) + b * weight) >> 8;
+}
+
+// What EE.VMUL.U8 with SAR = 8 and EE.VADDS.U8 do to one lane
+static int pie_lane(int a, int b, int weight)
+{
+    int sum = ((a * (256 - weight)) >> 8) + ((b * weight) >> 8);
+
+    return sum > 255 ? 255 : sum;
+}
+
+// Every weight and `a`, with all values of `b` in one row
+static bool check_c()
+{
+    _Alignas(16) uint8_t a[256], b[256], dst[256];
+    int wrong = 0;
+
+    for (int i = 0; i < 256; i++)
+        b[i] = i;
+
+    for (int weight = 0; weight < 256; weight++) {
+        for (int value = 0; value < 256; value++) {
+            memset(a, value, sizeof(a));
+            blend_columns(dst, a, b, weight, sizeof(dst));
+
+            for (int i = 0; i < 256; i++)
+                wrong += dst[i] != formula(value, i, weight);
+        }
+    }
+
+    printf("%-20s %10d wrong\n", "c", wrong);
+
+    return wrong == 0;
+}
+
+static bool check_pie_model()
+{
+    int below = 0, wrong = 0;
+
+    // blend_columns() doesn't call the vector code for a zero weight
+    for (int weight = 1; weight < 256; weight++) {
+        for (int a = 0; a < 256; a++) {
+            for (int b = 0; b < 256; b++) {
+                int difference = formula(a, b, weight) - pie_lane(a, b, weight);
+
+                below += difference == 1;
+                wrong += difference != 0 && difference != 1;
+            }
+        }
+    }
+
+    printf("%-20s %10d wrong, %d one below\n", "vector lanes", wrong, below);
+
+    return wrong == 0;
+}
+
+static double seconds()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static void benchmark()
+{
+    _Alignas(16) static uint8_t a[COLUMN_SIZE], b[COLUMN_SIZE], dst[COLUMN_SIZE];
+    unsigned checksum = 0;
+
+    for (int i = 0; i < COLUMN_SIZE; i++) {
+        a[i] = i * 7;
+        b[i] = 255 - i * 3;
+    }
+
+    double start = seconds();
+
+    for (int i = 0; i < BENCHMARK_COLUMNS; i++) {
+        blend_columns(dst, a, b, (i & 0xff) | 1, COLUMN_SIZE);
+        checksum += dst[i % COLUMN_SIZE];
+    }
+
+    double elapsed = seconds() - start;
+
+    printf("%-20s %10.1f ns per column (checksum %u)\n", "c benchmark", elapsed * 1e9 / BENCHMARK_COLUMNS, checksum);
+}
+
+int main()
+{
+    bool ok = check_c();
+
+    ok &= check_pie_model();
+    benchmark();
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,117 @@
+// Replays hall sensor edges recorded on the wheel (see edge-recorder.h)
+// through the tracker's filter, the same way the firmware does after each
+// ride, and reports for every recording the angular error the render loop
+// would have seen, the delay of the tracker task and the time the filter
+// takes per edge. The time is in nanoseconds of the PC, not cycles of the
+// ESP32.
+//
+//   edge-replay [--max-error degrees] edges000.csv ...
+//
+// Fails if a recording can't be read, or if its average error is above
+// the given limit.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "app-config.h"
+#include "edge-replay.h"
+
+static uint32_t nanoseconds()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint32_t)(now.tv_sec * 1000000000ull + now.tv_nsec);
+}
+
+static bool replay_file(const char *path, edge_replay *replay)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        return false;
+    }
+
+    edge_replay_init(replay, nanoseconds);
+
+    char line[128];
+    int number = 0;
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        long long timestamp;
+        int sensor;
+        long delay;
+
+        // The header
+        if (number++ == 0 && strncmp(line, "timestamp_us", 12) == 0)
+            continue;
+
+        if (sscanf(line, "%lld,%d,%ld", &timestamp, &sensor, &delay) != 3 || sensor < 0 || sensor >= MAX_ARMS) {
+            fprintf(stderr, "%s:%d: not an edge\n", path, number);
+            fclose(f);
+            return false;
+        }
+
+        edge_replay_edge(replay, sensor, timestamp, delay);
+    }
+
+    fclose(f);
+
+    if (replay->edges == 0) {
+        fprintf(stderr, "%s: no edges\n", path);
+        return false;
+    }
+
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    float max_error = -1;
+    int first = 1;
+
+    if (argc > 2 && strcmp(argv[1], "--max-error") == 0) {
+        max_error = atof(argv[2]);
+        first = 3;
+    }
+
+    if (first >= argc) {
+        fprintf(stderr, "Usage: %s [--max-error degrees] edges000.csv ...\n", argv[0]);
+        return 2;
+    }
+
+    bool ok = true;
+
+    printf("%-20s %6s %8s %8s %9s %9s %7s %8s %8s %8s %8s\n",
+           "recording", "edges", "mean deg", "max deg", "delay avg", "delay max", "ns/edge",
+           "bounces", "outliers", "inferred", "resyncs");
+
+    for (int i = first; i < argc; i++) {
+        edge_replay replay;
+
+        if (!replay_file(argv[i], &replay)) {
+            ok = false;
+            continue;
+        }
+
+        const char *name = strrchr(argv[i], '/');
+        const hall_tracker_counters *counters = &replay.filter.counters;
+        float error_mean = replay.errors > 0 ? replay.error_sum / replay.errors : 0;
+        bool within = max_error < 0 || error_mean <= max_error;
+
+        printf("%-20s %6lu %8.3f %8.3f %9lld %9ld %7llu %8lu %8lu %8lu %8lu%s\n",
+               name != NULL ? name + 1 : argv[i], (unsigned long)replay.edges, error_mean, replay.error_max,
+               (long long)(replay.delay_sum / replay.edges), (long)replay.delay_max,
+               (unsigned long long)(replay.ticks / replay.edges),
+               (unsigned long)counters->bounces, (unsigned long)counters->outliers,
+               (unsigned long)counters->inferred, (unsigned long)counters->resyncs,
+               within ? "" : "  FAIL");
+
+        ok &= within;
+    }
+
+    return ok ? 0 : 1;
+}
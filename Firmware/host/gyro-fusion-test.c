@@ -0,0 +1,289 @@
+// Runs gyro and hall sensor traces through the tracker's filter, once with
+// the gyro samples and once without, and compares the two.
+//
+// Without arguments, the traces are synthetic: a wheel whose speed varies
+// within a revolution, a gyro with a bias and noise that may drop out
+// halfway. The error is measured against the simulated wheel every
+// millisecond, the way the render loop would see it. Fails if fusing the
+// gyro doesn't beat the hall sensors alone on a wobbling wheel, or if a
+// case gets worse than its limits.
+//
+// With a file argument, the trace is read from a CSV file with one event
+// per line: timestamp in microseconds, sensor, rate. Sensor -1 is a gyro
+// sample with its rate in revolutions per second, the others are hall
+// edges. Without a known wheel, the error is measured at the edges only.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "app-config.h"
+#include "hall-tracker.h"
+
+// Edges after a restart before the estimate is judged
+#define SETTLE_EDGES 8
+
+#define GYRO_SENSOR -1
+#define GYRO_INTERVAL_US 2000
+#define STEP_US 10
+
+// Timestamps start here, the estimator takes zero for "no edge yet"
+#define START_US 1000000
+
+typedef struct {
+    int64_t timestamp;
+    int sensor;
+    float rate;
+} trace_event;
+
+typedef struct {
+    trace_event *events;
+    int count;
+    int capacity;
+} trace;
+
+typedef struct {
+    const char *name;
+    double speed;      // in revolutions per second
+    double wobble;     // speed modulation once per revolution, relative to the speed
+    double bias;       // of the gyro, in revolutions per second
+    double noise;      // of the gyro, up to this much either way
+    double gyro_stop;  // the gyro drops out after this many seconds
+    double duration;   // in seconds
+
+    // Limits on the error with the gyro, in degrees
+    float max_mean_error;
+    float max_error;
+} test_case;
+
+static const test_case cases[] = {
+    { "steady", 5, 0, 0.05, 0.02, 100, 10, 0.5f, 2.0f },
+    { "wobble", 5, 0.1, 0.05, 0.02, 100, 10, 0.5f, 3.0f },
+    { "strong wobble", 3, 0.3, 0.1, 0.05, 100, 10, 1.0f, 5.0f },
+    // Has to fall back to the hall sensors without a jump
+    { "gyro drops out", 5, 0.1, 0.05, 0.02, 5, 10, 6.0f, 15.0f },
+};
+
+#define CASE_COUNT (sizeof(cases) / sizeof(cases[0]))
+
+typedef struct {
+    int measured;
+    double error_sum;
+    float error_max;
+} error_stats;
+
+static void error_add(error_stats *stats, float error)
+{
+    stats->error_sum += error;
+    if (error > stats->error_max)
+        stats->error_max = error;
+
+    stats->measured++;
+}
+
+static float error_mean(const error_stats *stats)
+{
+    return stats->measured > 0 ? stats->error_sum / stats->measured : 0;
+}
+
+static void trace_add(trace *t, int64_t timestamp, int sensor, float rate)
+{
+    if (t->count == t->capacity) {
+        t->capacity = t->capacity > 0 ? t->capacity * 2 : 4096;
+        t->events = realloc(t->events, t->capacity * sizeof(trace_event));
+    }
+
+    t->events[t->count++] = (trace_event) { timestamp, sensor, rate };
+}
+
+static uint32_t random_state = 1;
+
+// Uniform in [-1, 1)
+static double random_signed()
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+
+    return (random_state >> 8) / 8388608.0 - 1.0;
+}
+
+static double case_speed(const test_case *c, double position)
+{
+    return c->speed * (1.0 + c->wobble * sin(2.0 * M_PI * position));
+}
+
+// Sensor at each quarter of a revolution, in the estimator's positions
+static int quarter_sensor[MAX_ARMS];
+
+static void map_sensors()
+{
+    for (int i = 0; i < MAX_ARMS; i++) {
+        float position = hall_tracker_phase_to_position(hall_tracker_sensor_phase(i));
+
+        quarter_sensor[(int)lroundf(angle_estimator_normalize(position) * MAX_ARMS) % MAX_ARMS] = i;
+    }
+}
+
+// Feeds one event to the filter, the way the tracker task does
+static void feed(hall_tracker_filter *filter, const trace_event *event, bool use_gyro)
+{
+    if (event->sensor == GYRO_SENSOR) {
+        if (use_gyro)
+            gyro_fusion_sample(&filter->fusion, &filter->estimator, event->timestamp, event->rate);
+    } else {
+        hall_tracker_filter_edge(filter, event->sensor, event->timestamp);
+    }
+}
+
+// Error of the estimate just before an edge, against where the sensor is
+static void measure_edge(const hall_tracker_filter *filter, const trace_event *event, error_stats *stats)
+{
+    if (event->sensor == GYRO_SENSOR || filter->estimator.edges < SETTLE_EDGES)
+        return;
+
+    float predicted = angle_estimator_position_at(&filter->estimator, event->timestamp);
+    float actual = hall_tracker_phase_to_position(hall_tracker_sensor_phase(event->sensor));
+
+    error_add(stats, fabsf(angle_estimator_wrap(predicted - actual)) * 360.0f);
+}
+
+static bool run_case(const test_case *c)
+{
+    error_stats stats[2] = {};
+    float bias = 0, max_acceleration = 0;
+
+    for (int use_gyro = 0; use_gyro <= 1; use_gyro++) {
+        hall_tracker_filter filter;
+        double position = 0;
+
+        hall_tracker_filter_init(&filter);
+        random_state = 1;
+
+        for (int64_t t = 0; t < c->duration * 1e6; t += STEP_US) {
+            int64_t timestamp = START_US + t;
+            double speed = case_speed(c, position);
+            double next = position + speed * STEP_US * 1e-6;
+
+            if (floor(next * MAX_ARMS) != floor(position * MAX_ARMS)) {
+                long quarter = (long)floor(next * MAX_ARMS) % MAX_ARMS;
+                trace_event edge = { timestamp, quarter_sensor[quarter], 0 };
+
+                feed(&filter, &edge, use_gyro);
+            }
+
+            position = next;
+
+            if (t % GYRO_INTERVAL_US == 0 && t < c->gyro_stop * 1e6) {
+                trace_event sample = { timestamp, GYRO_SENSOR, speed + c->bias + c->noise * random_signed() };
+
+                feed(&filter, &sample, use_gyro);
+            }
+
+            // Where the render loop would think the wheel is
+            if (t % 1000 == 0 && filter.estimator.edges >= SETTLE_EDGES) {
+                float estimate = angle_estimator_position_at(&filter.estimator, timestamp);
+                float truth = (float)(position - floor(position));
+
+                error_add(&stats[use_gyro], fabsf(angle_estimator_wrap(estimate - truth)) * 360.0f);
+
+                if (use_gyro && t > c->gyro_stop * 1e6 && fabsf(filter.estimator.acceleration) > max_acceleration)
+                    max_acceleration = fabsf(filter.estimator.acceleration);
+            }
+        }
+
+        if (use_gyro)
+            bias = filter.fusion.bias;
+    }
+
+    const error_stats *hall = &stats[0], *fused = &stats[1];
+    bool ok = fused->measured > 0 &&
+              error_mean(fused) <= c->max_mean_error && fused->error_max <= c->max_error;
+
+    // Where the speed varies within a revolution, the gyro has to pay off
+    // while it is there
+    if (c->wobble > 0 && c->gyro_stop >= c->duration)
+        ok &= error_mean(fused) < error_mean(hall) && fabsf(bias - (float)c->bias) < 0.02f;
+
+    printf("%-16s %9.3f %9.3f %9.3f %9.3f %7.3f %7.3f",
+           c->name, error_mean(hall), hall->error_max, error_mean(fused), fused->error_max, bias, c->bias);
+
+    if (c->gyro_stop < c->duration)
+        printf("  accel after dropout %.2f", max_acceleration);
+
+    printf("  %s\n", ok ? "ok" : "FAIL");
+
+    return ok;
+}
+
+static bool read_trace(const char *path, trace *t)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        return false;
+    }
+
+    char line[128];
+    while (fgets(line, sizeof(line), f) != NULL) {
+        long long timestamp;
+        int sensor;
+        float rate = 0;
+
+        if (sscanf(line, "%lld,%d,%f", &timestamp, &sensor, &rate) >= 2 && sensor < MAX_ARMS)
+            trace_add(t, timestamp, sensor, rate);
+    }
+
+    fclose(f);
+
+    return t->count > 0;
+}
+
+static int run_trace(const char *path)
+{
+    trace t = {};
+
+    if (!read_trace(path, &t)) {
+        fprintf(stderr, "No events in %s\n", path);
+        return 1;
+    }
+
+    printf("%-10s %9s %9s %7s\n", "", "edge avg", "edge max", "bias");
+
+    for (int use_gyro = 0; use_gyro <= 1; use_gyro++) {
+        hall_tracker_filter filter;
+        error_stats stats = {};
+
+        hall_tracker_filter_init(&filter);
+
+        for (int i = 0; i < t.count; i++) {
+            measure_edge(&filter, &t.events[i], &stats);
+            feed(&filter, &t.events[i], use_gyro);
+        }
+
+        printf("%-10s %9.3f %9.3f %7.3f\n", use_gyro ? "fused" : "hall only",
+               error_mean(&stats), stats.error_max, filter.fusion.bias);
+    }
+
+    free(t.events);
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    map_sensors();
+
+    if (argc > 1)
+        return run_trace(argv[1]);
+
+    bool ok = true;
+
+    printf("%-16s %9s %9s %9s %9s %7s %7s\n",
+           "case", "hall avg", "hall max", "fused avg", "fused max", "bias", "true");
+
+    for (size_t i = 0; i < CASE_COUNT; i++)
+        ok &= run_case(&cases[i]);
+
+    return ok ? 0 : 1;
+}
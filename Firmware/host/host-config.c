@@ -0,0 +1,13 @@
+#include "app-config.h"
+
+// The arms as configured in app-config.c, without the hardware behind them
+static app_config config = {
+    .arm = {
+        { .hall_sensor_pin = 0, .angle = 0 },
+        { .hall_sensor_pin = 1, .angle = 90 },
+        { .hall_sensor_pin = 2, .angle = 180 },
+        { .hall_sensor_pin = 3, .angle = 270 },
+    },
+};
+
+app_config *global_app_config = &config;
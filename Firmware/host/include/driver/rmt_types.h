@@ -0,0 +1,4 @@
+#pragma once
+
+// Only named in the led_strip configuration, which the host build doesn't use
+typedef int rmt_clock_source_t;
@@ -0,0 +1,5 @@
+#pragma once
+
+// Only named in the led_strip configuration, which the host build doesn't use
+typedef int spi_clock_source_t;
+typedef int spi_host_device_t;
@@ -0,0 +1,6 @@
+#pragma once
+
+#define ESP_IDF_VERSION_VAL(major, minor, patch) (((major) << 16) | ((minor) << 8) | (patch))
+
+// The version the firmware is built with
+#define ESP_IDF_VERSION ESP_IDF_VERSION_VAL(5, 2, 1)
@@ -0,0 +1,9 @@
+#pragma once
+
+// Only what the headers of the host-built code need from it
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
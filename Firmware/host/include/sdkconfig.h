@@ -0,0 +1,4 @@
+#pragma once
+
+// The host build has none of the firmware's options set, so the code
+// under test takes its portable paths
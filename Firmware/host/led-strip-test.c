@@ -0,0 +1,289 @@
+// Runs led_strip_refresh_multi() against mock strips that log every call
+// and simulate the time a transfer takes. Checks that all transfers are
+// started before the first wait, that every started transfer is waited
+// for exactly once, and that errors and strips without an asynchronous
+// refresh are handled. Reports how much the transfers overlap compared
+// to refreshing the arms one after another.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "led_strip.h"
+#include "led_strip_interface.h"
+
+#define STRIPS 4
+
+// 32 LEDs of 24 bits at 800 kHz, plus the reset
+#define TRANSFER_US 1010
+
+// CPU time to set up a transfer
+#define START_US 5
+
+#define MAX_CALLS 64
+
+typedef enum {
+    CALL_START,
+    CALL_WAIT,
+    CALL_REFRESH,
+} call_type;
+
+typedef struct {
+    call_type type;
+    int strip;
+} call;
+
+typedef struct {
+    led_strip_t base;
+    int id;
+    int64_t busy_until;      // end of the transfer in flight, in simulated time
+    bool in_flight;
+    esp_err_t start_result;
+    esp_err_t wait_result;
+} mock_strip;
+
+static int64_t now;
+static int64_t busy_us[STRIPS];  // time each strip spent transmitting
+static call calls[MAX_CALLS];
+static int num_calls;
+static bool misuse;  // a wait without a start, or a start while busy
+
+static void log_call(call_type type, const mock_strip *strip)
+{
+    if (num_calls < MAX_CALLS)
+        calls[num_calls++] = (call) { type, strip->id };
+}
+
+static esp_err_t mock_refresh_start(led_strip_t *base)
+{
+    mock_strip *strip = (mock_strip *)base;
+
+    log_call(CALL_START, strip);
+    now += START_US;
+
+    if (strip->start_result != ESP_OK)
+        return strip->start_result;
+
+    if (strip->in_flight)
+        misuse = true;
+
+    strip->in_flight = true;
+    strip->busy_until = now + TRANSFER_US;
+    busy_us[strip->id] += TRANSFER_US;
+
+    return ESP_OK;
+}
+
+static esp_err_t mock_refresh_wait(led_strip_t *base)
+{
+    mock_strip *strip = (mock_strip *)base;
+
+    log_call(CALL_WAIT, strip);
+
+    if (!strip->in_flight)
+        misuse = true;
+
+    if (strip->busy_until > now)
+        now = strip->busy_until;
+
+    strip->in_flight = false;
+
+    return strip->wait_result;
+}
+
+static esp_err_t mock_refresh(led_strip_t *base)
+{
+    mock_strip *strip = (mock_strip *)base;
+
+    log_call(CALL_REFRESH, strip);
+    now += START_US + TRANSFER_US;
+    busy_us[strip->id] += TRANSFER_US;
+
+    return strip->start_result;
+}
+
+static mock_strip mocks[STRIPS];
+static led_strip_handle_t handles[STRIPS];
+
+static void reset(bool async)
+{
+    now = 0;
+    num_calls = 0;
+    misuse = false;
+    memset(busy_us, 0, sizeof(busy_us));
+
+    for (int i = 0; i < STRIPS; i++) {
+        mocks[i] = (mock_strip) {
+            .base = {
+                .refresh = mock_refresh,
+                .refresh_start = async ? mock_refresh_start : NULL,
+                .refresh_wait = async ? mock_refresh_wait : NULL,
+            },
+            .id = i,
+        };
+        handles[i] = &mocks[i].base;
+    }
+}
+
+static int count_calls(call_type type, int strip)
+{
+    int count = 0;
+
+    for (int i = 0; i < num_calls; i++)
+        count += calls[i].type == type && calls[i].strip == strip;
+
+    return count;
+}
+
+// Every strip refreshed exactly once, and nothing waited for before the
+// last transfer was started
+static bool check_order(const bool *skipped)
+{
+    int last_start = -1, first_wait = num_calls;
+
+    for (int i = 0; i < num_calls; i++) {
+        if (calls[i].type == CALL_WAIT) {
+            if (i < first_wait)
+                first_wait = i;
+        } else {
+            last_start = i;
+        }
+    }
+
+    if (misuse || last_start > first_wait)
+        return false;
+
+    for (int i = 0; i < STRIPS; i++) {
+        bool skip = skipped != NULL && skipped[i];
+        int started = count_calls(CALL_START, i), waited = count_calls(CALL_WAIT, i);
+        int refreshed = count_calls(CALL_REFRESH, i);
+
+        if (skip ? started + refreshed != 0 : started + refreshed != 1)
+            return false;
+
+        if (mocks[i].start_result == ESP_OK ? waited != started : waited != 0)
+            return false;
+    }
+
+    return true;
+}
+
+static bool report(const char *name, bool ok)
+{
+    int64_t busy = 0;
+
+    for (int i = 0; i < STRIPS; i++)
+        busy += busy_us[i];
+
+    printf("%-24s %6d %8lld %8lld %8.2f  %s\n", name, num_calls, (long long)now, (long long)busy,
+           now > 0 ? (double)busy / now : 0, ok ? "ok" : "FAIL");
+
+    return ok;
+}
+
+static bool test_serial()
+{
+    reset(true);
+
+    bool ok = true;
+    for (int i = 0; i < STRIPS; i++)
+        ok &= led_strip_refresh(handles[i]) == ESP_OK;
+
+    // The reference the overlap is compared with
+    return report("one after another", ok && !misuse);
+}
+
+static bool test_parallel()
+{
+    reset(true);
+
+    esp_err_t err = led_strip_refresh_multi(handles, STRIPS);
+    bool ok = err == ESP_OK && check_order(NULL) &&
+              now <= STRIPS * START_US + TRANSFER_US;
+
+    return report("all at once", ok);
+}
+
+static bool test_blocking_backend()
+{
+    reset(false);
+
+    esp_err_t err = led_strip_refresh_multi(handles, STRIPS);
+
+    return report("blocking backend", err == ESP_OK && check_order(NULL));
+}
+
+static bool test_mixed()
+{
+    reset(true);
+    mocks[2].base.refresh_start = NULL;
+    mocks[2].base.refresh_wait = NULL;
+
+    esp_err_t err = led_strip_refresh_multi(handles, STRIPS);
+    bool ok = err == ESP_OK && check_order(NULL) && count_calls(CALL_REFRESH, 2) == 1;
+
+    return report("one blocking strip", ok);
+}
+
+static bool test_missing_strip()
+{
+    reset(true);
+    handles[1] = NULL;
+
+    const bool skipped[STRIPS] = { false, true, false, false };
+    esp_err_t err = led_strip_refresh_multi(handles, STRIPS);
+
+    return report("missing strip", err == ESP_OK && check_order(skipped));
+}
+
+static bool test_start_fails()
+{
+    reset(true);
+    mocks[1].start_result = ESP_FAIL;
+
+    // The others still go out, and only they are waited for
+    esp_err_t err = led_strip_refresh_multi(handles, STRIPS);
+
+    return report("start fails", err == ESP_FAIL && check_order(NULL));
+}
+
+static bool test_wait_fails()
+{
+    reset(true);
+    mocks[2].wait_result = ESP_ERR_INVALID_STATE;
+    mocks[3].wait_result = ESP_FAIL;
+
+    // The first error is reported, and every transfer is still waited for
+    esp_err_t err = led_strip_refresh_multi(handles, STRIPS);
+
+    return report("wait fails", err == ESP_ERR_INVALID_STATE && check_order(NULL));
+}
+
+static bool test_arguments()
+{
+    reset(true);
+
+    led_strip_handle_t many[33] = {};
+    bool ok = led_strip_refresh_multi(NULL, STRIPS) == ESP_ERR_INVALID_ARG &&
+              led_strip_refresh_multi(many, 33) == ESP_ERR_INVALID_ARG &&
+              led_strip_refresh_multi(handles, 0) == ESP_OK;
+
+    return report("invalid arguments", ok && num_calls == 0);
+}
+
+int main()
+{
+    bool ok = true;
+
+    printf("%-24s %6s %8s %8s %8s\n", "case", "calls", "took us", "busy us", "overlap");
+
+    ok &= test_serial();
+    ok &= test_parallel();
+    ok &= test_blocking_backend();
+    ok &= test_mixed();
+    ok &= test_missing_strip();
+    ok &= test_start_fails();
+    ok &= test_wait_fails();
+    ok &= test_arguments();
+
+    return ok ? 0 : 1;
+}
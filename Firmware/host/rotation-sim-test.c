@@ -0,0 +1,152 @@
+// Runs speed profiles through the rotation simulator and the tracker's
+// per-edge filter, and reports how far the estimate is off from the
+// simulated wheel. Fails if a profile gets worse than its limits, or if the
+// filter drops, infers or restarts anything on a profile that neither
+// drops edges nor bounces.
+
+#include <math.h>
+#include <stdio.h>
+
+#include "app-config.h"
+#include "hall-tracker.h"
+#include "rotation-sim.h"
+
+// Edges after a restart of the estimate before it is judged
+#define SETTLE_EDGES 8
+
+// Below this, in revolutions per second, the wheel isn't rendered anyway
+#define MIN_SPEED 1.0f
+
+typedef struct {
+    const char *name;
+    const rotation_sim_segment *segments;
+    int num_segments;
+    float jitter_us;
+    float dropout;
+    float bounce;
+    float wobble;
+
+    // Limits on the error of the estimate at the edges, in degrees
+    float max_mean_error;
+    float max_error;
+} profile;
+
+static const rotation_sim_segment steady[] = {
+    { 1000, 8.0f },
+    { 20000, 8.0f },
+};
+
+static const rotation_sim_segment ramps[] = {
+    { 5000, 10.0f },  // spin up
+    { 5000, 10.0f },
+    { 3000, 2.0f },   // brake hard
+    { 5000, 6.0f },
+    { 3000, 0.0f },   // stop
+};
+
+static const rotation_sim_segment backwards[] = {
+    { 2000, -5.0f },
+    { 10000, -5.0f },
+};
+
+static const profile profiles[] = {
+    { "steady", steady, 2, 0, 0, 0, 0, 0.25f, 10.0f },
+    // The estimate overshoots for a few edges where braking turns into
+    // speeding up at low speed
+    { "ramps", ramps, 5, 0, 0, 0, 0, 1.0f, 50.0f },
+    { "backwards", backwards, 2, 0, 0, 0, 0, 0.5f, 10.0f },
+    { "noisy", steady, 2, 20, 0.02f, 0.02f, 0, 0.5f, 20.0f },
+    // Speed changes within a revolution are beyond the hall edges alone
+    { "wobbly", steady, 2, 20, 0, 0, 0.05f, 4.0f, 15.0f },
+    { "noisy ramps", ramps, 5, 20, 0.02f, 0.02f, 0.05f, 5.0f, 50.0f },
+};
+
+#define PROFILE_COUNT (sizeof(profiles) / sizeof(profiles[0]))
+
+static bool run_profile(const profile *p)
+{
+    rotation_sim_config config = {
+        .segments = p->segments,
+        .num_segments = p->num_segments,
+        .num_sensors = MAX_ARMS,
+        .jitter_us = p->jitter_us,
+        .dropout = p->dropout,
+        .bounce = p->bounce,
+        .bounce_us = 300,
+        .wobble = p->wobble,
+        .seed = 1234,
+    };
+
+    for (int i = 0; i < MAX_ARMS; i++)
+        config.sensor_positions[i] = hall_tracker_phase_to_position(hall_tracker_sensor_phase(i));
+
+    rotation_sim sim;
+    hall_tracker_filter filter;
+
+    rotation_sim_init(&sim, &config);
+    hall_tracker_filter_init(&filter);
+
+    // The wheel keeps the last speed after the profile, stop there
+    int64_t end = 0;
+    for (int i = 0; i < p->num_segments; i++)
+        end += (int64_t)p->segments[i].duration_ms * 1000;
+
+    int edges = 0, measured = 0;
+    double error_sum = 0;
+    float error_max = 0;
+    int sensor;
+    int64_t timestamp;
+
+    while (rotation_sim_next_edge(&sim, &sensor, &timestamp) && timestamp < end) {
+        edges++;
+
+        // Where the render loop would have thought the wheel was, just
+        // before the edge came in. Spinning up from standstill, the first
+        // few edges only give a rough speed, so the estimate is judged
+        // once it has settled and the wheel is fast enough to render.
+        const angle_estimator *estimator = &filter.estimator;
+
+        if (estimator->edges >= SETTLE_EDGES && fabsf(estimator->velocity) >= MIN_SPEED) {
+            float predicted = angle_estimator_position_at(estimator, timestamp);
+            float actual = angle_estimator_normalize((float)fmod(rotation_sim_position(&sim), 1.0));
+            float error = fabsf(angle_estimator_wrap(predicted - actual)) * 360.0f;
+
+            error_sum += error;
+            if (error > error_max)
+                error_max = error;
+
+            measured++;
+        }
+
+        hall_tracker_filter_edge(&filter, sensor, timestamp);
+    }
+
+    float error_mean = measured > 0 ? error_sum / measured : 0;
+    bool ok = measured > 0 && error_mean <= p->max_mean_error && error_max <= p->max_error;
+
+    // Every edge is real and in its place, so every one has to be taken
+    const hall_tracker_counters *counters = &filter.counters;
+    if (p->dropout == 0 && p->bounce == 0)
+        ok &= counters->bounces == 0 && counters->outliers == 0 && counters->inferred == 0 && counters->resyncs == 0;
+
+    printf("%-12s %6d %6d %8.3f %8.3f %8lu %8lu %8lu %8lu  %s\n",
+           p->name, edges, measured, error_mean, error_max,
+           (unsigned long)filter.counters.bounces, (unsigned long)filter.counters.outliers,
+           (unsigned long)filter.counters.inferred, (unsigned long)filter.counters.resyncs,
+           ok ? "ok" : "FAIL");
+
+    return ok;
+}
+
+int main()
+{
+    bool ok = true;
+
+    printf("%-12s %6s %6s %8s %8s %8s %8s %8s %8s\n",
+           "profile", "edges", "judged", "mean deg", "max deg", "bounces", "outliers", "inferred", "resyncs");
+
+    for (size_t i = 0; i < PROFILE_COUNT; i++)
+        ok &= run_profile(&profiles[i]);
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,122 @@
+// Hammers the tracker's snapshot seqlock with one writer and several
+// readers on their own threads. Every field of a written snapshot is
+// derived from the same counter, so a reader that gets a mix of two
+// updates sees fields that disagree. Fails if that ever happens, or if a
+// reader sees the updates go backwards.
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+
+#include "hall-tracker-snapshot.h"
+
+#define UPDATES 2000000
+#define READERS 3
+
+static hall_tracker_seqlock lock;
+static atomic_bool done;
+
+typedef struct {
+    uint64_t reads;
+    uint64_t torn;
+    uint64_t backwards;
+} reader_result;
+
+static void snapshot_for(uint32_t n, hall_tracker_snapshot *snapshot)
+{
+    snapshot->timestamp = n;
+    snapshot->phase = (phase_t)(n * 7);
+    snapshot->angle_delta = (int)(n % 360);
+    snapshot->frequency = -(int)n;
+    snapshot->acceleration = (float)(n & 0xffff);
+    snapshot->valid = n & 1;
+    snapshot->sensors = (int)(n % 5);
+    snapshot->counters.bounces = n;
+    snapshot->counters.outliers = n ^ 0x55555555;
+    snapshot->counters.inferred = ~n;
+    snapshot->counters.resyncs = n * 3;
+}
+
+static bool snapshot_consistent(const hall_tracker_snapshot *snapshot)
+{
+    hall_tracker_snapshot expected;
+
+    snapshot_for((uint32_t)snapshot->timestamp, &expected);
+
+    return snapshot->phase == expected.phase &&
+           snapshot->angle_delta == expected.angle_delta &&
+           snapshot->frequency == expected.frequency &&
+           snapshot->acceleration == expected.acceleration &&
+           snapshot->valid == expected.valid &&
+           snapshot->sensors == expected.sensors &&
+           snapshot->counters.bounces == expected.counters.bounces &&
+           snapshot->counters.outliers == expected.counters.outliers &&
+           snapshot->counters.inferred == expected.counters.inferred &&
+           snapshot->counters.resyncs == expected.counters.resyncs;
+}
+
+static void *writer_func(void *arg)
+{
+    hall_tracker_snapshot snapshot;
+
+    for (uint32_t n = 1; n <= UPDATES; n++) {
+        snapshot_for(n, &snapshot);
+        hall_tracker_snapshot_write(&lock, &snapshot);
+    }
+
+    atomic_store(&done, true);
+
+    return NULL;
+}
+
+static void *reader_func(void *arg)
+{
+    reader_result *result = arg;
+    hall_tracker_snapshot snapshot;
+    int64_t last = 0;
+
+    while (!atomic_load(&done)) {
+        hall_tracker_snapshot_read(&lock, &snapshot);
+        result->reads++;
+
+        if (!snapshot_consistent(&snapshot))
+            result->torn++;
+
+        if (snapshot.timestamp < last)
+            result->backwards++;
+
+        last = snapshot.timestamp;
+    }
+
+    return NULL;
+}
+
+int main()
+{
+    hall_tracker_snapshot initial;
+    pthread_t writer, readers[READERS];
+    reader_result results[READERS] = {};
+    bool ok = true;
+
+    snapshot_for(0, &initial);
+    atomic_init(&lock.sequence, 0);
+    hall_tracker_snapshot_write(&lock, &initial);
+
+    for (int i = 0; i < READERS; i++)
+        pthread_create(&readers[i], NULL, reader_func, &results[i]);
+
+    pthread_create(&writer, NULL, writer_func, NULL);
+    pthread_join(writer, NULL);
+
+    for (int i = 0; i < READERS; i++) {
+        pthread_join(readers[i], NULL);
+
+        printf("reader %d: %llu reads, %llu torn, %llu backwards\n", i,
+               (unsigned long long)results[i].reads, (unsigned long long)results[i].torn,
+               (unsigned long long)results[i].backwards);
+
+        ok &= results[i].reads > 0 && results[i].torn == 0 && results[i].backwards == 0;
+    }
+
+    return ok ? 0 : 1;
+}
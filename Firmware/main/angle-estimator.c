@@ -0,0 +1,120 @@
+#include <math.h>
+
+#include "angle-estimator.h"
+
+void angle_estimator_init(angle_estimator *estimator, const angle_estimator_config *config)
+{
+    estimator->config = *config;
+    estimator->direction_hint = 0;
+    angle_estimator_reset(estimator);
+}
+
+void angle_estimator_reset(angle_estimator *estimator)
+{
+    estimator->edges = 0;
+    estimator->timestamp = 0;
+    estimator->interval = 0;
+    estimator->propagated_at = 0;
+    estimator->position = 0;
+    estimator->velocity = 0;
+    estimator->acceleration = 0;
+    estimator->residual = 0;
+}
+
+void angle_estimator_update(angle_estimator *estimator, int64_t timestamp, float position)
+{
+    const angle_estimator_config *config = &estimator->config;
+    int64_t interval = timestamp - estimator->timestamp;
+
+    if (estimator->edges > 0 && (interval <= 0 || interval > config->max_interval_us))
+        angle_estimator_reset(estimator);
+
+    switch (estimator->edges) {
+    case 0:
+        // Nothing to go by but the position
+        estimator->position = angle_estimator_normalize(position);
+        break;
+
+    case 1: {
+        // First velocity estimate from two edges. The wheel is assumed to
+        // have turned by less than half a revolution, which tells the
+        // direction from the order in which the sensors fired.
+        float delta = angle_estimator_wrap(position - estimator->position);
+
+        if (delta == 0)
+            delta = 1.0f;  // the same sensor, one revolution later
+
+        // Half a revolution could be either way. Going by the direction
+        // the wheel turned last time is the best guess.
+        if (fabsf(delta) > 0.45f && estimator->direction_hint != 0)
+            delta = estimator->direction_hint * fabsf(delta);
+
+        estimator->position = angle_estimator_normalize(position);
+        estimator->velocity = delta * 1e6f / interval;
+        estimator->direction_hint = delta > 0 ? 1 : -1;
+        break;
+    }
+
+    case 2:
+        // The speeds over the first two intervals give a first
+        // acceleration. Spinning up from standstill, the first one is far
+        // below the speed at the edge, and the gains alone would take many
+        // edges to catch up. Not if the gyro has moved the estimate on
+        // since the last edge, though.
+        if (estimator->propagated_at == estimator->timestamp) {
+            float dt = interval * 1e-6f;
+            float travel = estimator->velocity * dt;
+
+            travel += angle_estimator_wrap(position - (estimator->position + travel));
+
+            float velocity = travel / dt;
+
+            estimator->acceleration = (velocity - estimator->velocity) / (0.5f * (dt + estimator->interval * 1e-6f));
+            estimator->velocity = velocity + 0.5f * estimator->acceleration * dt;
+            estimator->position = angle_estimator_normalize(position);
+            estimator->direction_hint = estimator->velocity >= 0 ? 1 : -1;
+            break;
+        }
+        // fall through
+
+    default: {
+        // The gyro may have carried the estimate on past the last edge.
+        // The prediction starts from there, the corrections are spread
+        // over the time since the last edge.
+        float dt = interval * 1e-6f;
+        float span = (timestamp - estimator->propagated_at) * 1e-6f;
+
+        // Predict forward to the edge...
+        float predicted = estimator->position + estimator->velocity * span + 0.5f * estimator->acceleration * span * span;
+        float velocity = estimator->velocity + estimator->acceleration * span;
+
+        // ...and correct by how far off the prediction was
+        float residual = angle_estimator_wrap(position - predicted);
+
+        estimator->position = angle_estimator_normalize(predicted + config->alpha * residual);
+        estimator->velocity = velocity + config->beta * residual / dt;
+        estimator->acceleration += 2.0f * config->gamma * residual / (dt * dt);
+        estimator->residual = residual;
+        estimator->direction_hint = estimator->velocity >= 0 ? 1 : -1;
+        break;
+    }
+    }
+
+    estimator->interval = estimator->edges > 0 ? interval : 0;
+    estimator->timestamp = timestamp;
+    estimator->propagated_at = timestamp;
+    estimator->edges++;
+}
+
+bool angle_estimator_valid(const angle_estimator *estimator)
+{
+    return estimator->edges >= 2;
+}
+
+float angle_estimator_position_at(const angle_estimator *estimator, int64_t timestamp)
+{
+    float dt = (timestamp - estimator->propagated_at) * 1e-6f;
+
+    return angle_estimator_normalize(estimator->position + estimator->velocity * dt +
+                                     0.5f * estimator->acceleration * dt * dt);
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Alpha-beta-gamma estimator for the wheel's rotation. Every hall sensor
+// edge is a measurement of where the wheel was at that time. The estimator
+// predicts position, velocity and acceleration forward to the edge and
+// corrects all three by the residual, so it follows a wheel that speeds up
+// or slows down without the lag of averaging per-edge speeds.
+//
+// Positions are in revolutions, counting up in the direction of rotation.
+// Timestamps are in microseconds. The code has no dependencies on the
+// ESP-IDF, host/angle-estimator-test.c checks it on a PC.
+
+typedef struct {
+    float alpha;  // position correction gain
+    float beta;   // velocity correction gain
+    float gamma;  // acceleration correction gain
+    int64_t max_interval_us;  // longer gaps between edges restart the estimate
+} angle_estimator_config;
+
+typedef struct {
+    angle_estimator_config config;
+    int edges;          // since the last restart
+    int64_t timestamp;  // of the last edge
+    int64_t interval;   // between the last two edges
+    int64_t propagated_at; // time the position, velocity and acceleration refer to
+    float position;     // in [0, 1)
+    float velocity;     // in revolutions per second, negative when turning backwards
+    float acceleration; // in revolutions per second squared
+    float residual;     // of the last edge, in revolutions
+    int direction_hint; // 1 or -1 for the direction the wheel last turned, 0 if unknown
+} angle_estimator;
+
+#define ANGLE_ESTIMATOR_DEFAULT_CONFIG() { \
+    .alpha = 0.6f,                         \
+    .beta = 0.3f,                          \
+    .gamma = 0.05f,                        \
+    .max_interval_us = 500000,             \
+}
+
+void angle_estimator_init(angle_estimator *estimator, const angle_estimator_config *config);
+void angle_estimator_reset(angle_estimator *estimator);
+
+// Feeds an edge: the wheel was at `position` (in revolutions) at `timestamp`
+void angle_estimator_update(angle_estimator *estimator, int64_t timestamp, float position);
+
+// True once there have been enough edges for a velocity estimate
+bool angle_estimator_valid(const angle_estimator *estimator);
+
+// Extrapolated position at the given time, in [0, 1)
+float angle_estimator_position_at(const angle_estimator *estimator, int64_t timestamp);
+
+// Wraps a position into [0, 1)
+static inline float angle_estimator_normalize(float position)
+{
+    position -= (int)position;
+
+    return position < 0 ? position + 1.0f : position;
+}
+
+// Wraps a difference of positions into [-0.5, 0.5)
+static inline float angle_estimator_wrap(float delta)
+{
+    delta -= (int)delta;
+
+    if (delta >= 0.5f)
+        delta -= 1.0f;
+    else if (delta < -0.5f)
+        delta += 1.0f;
+
+    return delta;
+}
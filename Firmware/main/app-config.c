@@ -17,24 +17,43 @@ esp_err_t load_app_config() {
     global_app_config->arm[0].led_pin = PIN_LED_STRIP_0;
     global_app_config->arm[0].angle = 0;
     global_app_config->arm[0].num_leds = 32;
+    global_app_config->arm[0].brightness = 255;
+    global_app_config->arm[0].phase_offset = 0;
 
     global_app_config->arm[1].hall_sensor_pin = PIN_HALL_SENSOR_1;
     global_app_config->arm[1].led_pin = PIN_LED_STRIP_1;
     global_app_config->arm[1].angle = 90;
     global_app_config->arm[1].num_leds = 32;
+    global_app_config->arm[1].brightness = 255;
+    global_app_config->arm[1].phase_offset = 0;
 
     global_app_config->arm[2].hall_sensor_pin = PIN_HALL_SENSOR_2;
     global_app_config->arm[2].led_pin = PIN_LED_STRIP_2;
     global_app_config->arm[2].angle = 180;
     global_app_config->arm[2].num_leds = 32;
+    global_app_config->arm[2].brightness = 255;
+    global_app_config->arm[2].phase_offset = 0;
 
     global_app_config->arm[3].hall_sensor_pin = PIN_HALL_SENSOR_3;
     global_app_config->arm[3].led_pin = PIN_LED_STRIP_3;
     global_app_config->arm[3].angle = 270;
     global_app_config->arm[3].num_leds = 32;
+    global_app_config->arm[3].brightness = 255;
+    global_app_config->arm[3].phase_offset = 0;
 
     global_app_config->pattern_change_interval_seconds = 10;
     global_app_config->angle_offset = 120;
+    global_app_config->latency_calibration = false;
+    global_app_config->interpolate_columns = true;
+    global_app_config->gamma = 2.2;
+    global_app_config->brightness = 255;
+    global_app_config->white_balance.r = 255;
+    global_app_config->white_balance.g = 255;
+    global_app_config->white_balance.b = 255;
+    global_app_config->power_budget_ma = 4000;
+    global_app_config->calibrate_sensors = false;
+    global_app_config->record_edges = false;
+    global_app_config->idle_timeout_seconds = 120;
 
     ESP_LOGI("app-app_config", "Loaded app_config");
 
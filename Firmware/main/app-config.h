@@ -9,12 +9,25 @@ typedef struct {
     int led_pin;
     int num_leds;
     int angle;
+    uint8_t brightness;  // per-arm correction, 255 = full
+    int16_t phase_offset; // learned mounting error of the sensor, see sensor-calibration.h
 } arm_config;
 
 typedef struct {
     arm_config arm[MAX_ARMS];
     int pattern_change_interval_seconds;
     int angle_offset;
+    bool latency_calibration;  // periodically log the measured output latency
+    bool interpolate_columns;  // blend neighbouring columns by the fractional phase
+    float gamma;               // LED gamma, applied through the colour tables
+    uint8_t brightness;        // global brightness, 255 = full
+    struct {
+        uint8_t r, g, b;
+    } white_balance;           // per-channel gain, 255 = full
+    int power_budget_ma;       // current budget for all LEDs together, 0 = unlimited
+    bool calibrate_sensors;    // learn the sensor offsets again, even if some are stored
+    bool record_edges;         // record the hall sensor edges of every ride, see edge-recorder.h
+    int idle_timeout_seconds;  // go to sleep after standing still this long, 0 = never
 } app_config;
 
 extern app_config *global_app_config;
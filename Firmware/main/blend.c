@@ -0,0 +1,32 @@
+#include <string.h>
+
+#include "sdkconfig.h"
+#include "blend.h"
+
+#if CONFIG_SPOKESPICE_BLEND_PIE
+// In blend_pie.S
+void blend_columns_pie(uint8_t *dst, const uint8_t *a, const uint8_t *b, uint8_t weight, size_t len);
+#endif
+
+void blend_columns_c(uint8_t *dst, const uint8_t *a, const uint8_t *b, uint8_t weight, size_t len)
+{
+    uint32_t wb = weight;
+    uint32_t wa = 256 - weight;
+
+    for (size_t i = 0; i < len; i++)
+        dst[i] = (a[i] * wa + b[i] * wb) >> 8;
+}
+
+void blend_columns(uint8_t *dst, const uint8_t *a, const uint8_t *b, uint8_t weight, size_t len)
+{
+    if (weight == 0) {
+        memcpy(dst, a, len);
+        return;
+    }
+
+#if CONFIG_SPOKESPICE_BLEND_PIE
+    blend_columns_pie(dst, a, b, weight, len);
+#else
+    blend_columns_c(dst, a, b, weight, len);
+#endif
+}
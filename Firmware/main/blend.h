@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Mixes two columns byte by byte, weighting `b` with `weight`/256 and `a`
+// with the rest:
+//
+//   dst[i] = (a[i] * (256 - weight) + b[i] * weight) >> 8
+//
+// All buffers must be 16-byte aligned and `len` a multiple of 16. With
+// CONFIG_SPOKESPICE_BLEND_PIE this runs on the ESP32-S3 vector unit,
+// which truncates each of the two products separately. Its result may
+// therefore be one below the formula above, but never more and never
+// above it. host/blend-test.c checks that bound for every input on a
+// model of the vector lanes.
+void blend_columns(uint8_t *dst, const uint8_t *a, const uint8_t *b, uint8_t weight, size_t len);
+
+// The portable implementation, always available
+void blend_columns_c(uint8_t *dst, const uint8_t *a, const uint8_t *b, uint8_t weight, size_t len);
@@ -1,11 +1,16 @@
 #include "freertos/FreeRTOS.h"
 #include <math.h>
 #include <string.h>
+#include <stdatomic.h>
+#include <limits.h>
 
 #include "app-config.h"
+#include "esp_heap_caps.h"
 #include "esp_log.h"
 #include "led_strip.h"
+#include "blend.h"
 #include "canvas.h"
+#include "power-limiter.h"
 
 #ifndef M_PI
 #define M_PI	3.14159265358979323846
@@ -13,23 +18,80 @@
 
 static const char *TAG = "canvas";
 
-Pixel *canvas;
+uint8_t *canvas;
+
+static uint8_t *buffers[2];
+static _Atomic(uint8_t *) pending;
+
+// Sum of the colour-corrected channel values of every column, per buffer,
+// computed once when a frame is committed. The power limiter uses these
+// instead of adding up pixels on every render pass.
+static uint16_t column_loads[2][CANVAS_WIDTH];
+static const uint16_t *loads = column_loads[0];
+static const uint16_t *pending_loads;
+
+// The last committed frame and its loads, either one of the buffers or a
+// frame that was presented in place
+static const uint8_t *last_frame;
+static const uint16_t *last_loads;
+
+// Producer state
+static int back_index = 1;
+static uint8_t *back;
+
+// Columns of the back buffer changed since canvas_begin_frame(), from
+// `changed_x0` up to `changed_x1`
+static int changed_x0, changed_x1;
+
+#if CONFIG_SPOKESPICE_CANVAS_INDEXED
+// Palette entries that canvas_set_pixel() found for colours of the frame
+// being drawn, direct mapped. Slots hold the index plus one, zero being
+// empty.
+#define NEAREST_CACHE_BITS 6
+#define NEAREST_CACHE_SIZE (1 << NEAREST_CACHE_BITS)
+
+static uint32_t nearest_colours[NEAREST_CACHE_SIZE];
+static uint16_t nearest_slots[NEAREST_CACHE_SIZE];
+#endif
+
+static uint8_t *canvas_alloc()
+{
+    // Columns are read on every render pass, so keep the canvas out of PSRAM if we can.
+    // The blending code wants 16-byte aligned columns.
+    uint8_t *buffer = heap_caps_aligned_alloc(16, CANVAS_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (buffer == NULL) {
+        ESP_LOGW(TAG, "No internal memory for canvas, falling back to default heap");
+        buffer = heap_caps_aligned_alloc(16, CANVAS_SIZE, MALLOC_CAP_DEFAULT);
+    }
+
+    return buffer;
+}
 
 void canvas_init()
 {
-    canvas = malloc(sizeof(Pixel) * CANVAS_WIDTH * CANVAS_HEIGHT);
+    buffers[0] = canvas_alloc();
+    buffers[1] = canvas_alloc();
+
+    canvas = buffers[0];
+    back = buffers[1];
+    last_frame = buffers[0];
+    last_loads = column_loads[0];
+    atomic_init(&pending, NULL);
+
     canvas_clear();
 }
 
 static inline int canvas_index(int x, int y)
 {
-    return y * CANVAS_WIDTH + x;
+    return (x * CANVAS_HEIGHT + y) * CANVAS_BYTES_PER_PIXEL;
 }
 
 void canvas_clear()
 {
     ESP_LOGI(TAG, "Clearing canvas");
-    memset(canvas, 0, sizeof(Pixel) * CANVAS_WIDTH * CANVAS_HEIGHT);
+    memset(buffers[0], 0, CANVAS_SIZE);
+    memset(buffers[1], 0, CANVAS_SIZE);
+    memset(column_loads, 0, sizeof(column_loads));
 }
 
 void canvas_dump()
@@ -37,26 +99,281 @@ void canvas_dump()
     ESP_LOG_BUFFER_HEX_LEVEL(TAG, canvas, 1024, ESP_LOG_INFO);
 }
 
+bool canvas_frame_pending()
+{
+    return atomic_load_explicit(&pending, memory_order_acquire) != NULL;
+}
+
+uint8_t *canvas_begin_frame()
+{
+    if (canvas_frame_pending())
+        return NULL;
+
+    // The render task is done with the previous front buffer once the
+    // pending pointer reads NULL again. Bring it up to date with the
+    // last committed frame, which producers only partially redraw.
+    back = buffers[back_index];
+    memcpy(back, last_frame, CANVAS_SIZE);
+    memcpy(column_loads[back_index], last_loads, sizeof(column_loads[0]));
+
+    changed_x0 = CANVAS_WIDTH;
+    changed_x1 = 0;
+
+#if CONFIG_SPOKESPICE_CANVAS_INDEXED
+    memset(nearest_slots, 0, sizeof(nearest_slots));
+#endif
+
+    return back;
+}
+
+void canvas_columns_changed(int x0, int x1)
+{
+    if (x0 < changed_x0)
+        changed_x0 = x0 < 0 ? 0 : x0;
+    if (x1 > changed_x1)
+        changed_x1 = x1 > CANVAS_WIDTH ? CANVAS_WIDTH : x1;
+}
+
+#if CONFIG_SPOKESPICE_CANVAS_INDEXED
+uint8_t canvas_palette_nearest(const uint8_t *palette, Pixel p)
+{
+    int best = 0;
+    int best_distance = INT_MAX;
+
+    for (int i = 0; i < CANVAS_PALETTE_ENTRIES; i++, palette += 3) {
+        int dg = palette[0] - p.g;
+        int dr = palette[1] - p.r;
+        int db = palette[2] - p.b;
+        int distance = dr * dr + dg * dg + db * db;
+
+        if (distance < best_distance) {
+            best = i;
+            best_distance = distance;
+        }
+    }
+
+    return best;
+}
+#endif
+
 void canvas_set_pixel(int x, int y, Pixel p)
 {
     if (x < 0 || x >= CANVAS_WIDTH || y < 0 || y >= CANVAS_HEIGHT)
         return;
 
-    int pixelIndex = canvas_index(x, y);
+    uint8_t *pixel = back + canvas_index(x, y);
 
-    canvas[pixelIndex].r = p.r;
-    canvas[pixelIndex].g = p.g;
-    canvas[pixelIndex].b = p.b;
+    canvas_columns_changed(x, x + 1);
+
+#if CONFIG_SPOKESPICE_CANVAS_INDEXED
+    uint32_t colour = p.r | p.g << 8 | p.b << 16;
+    uint32_t slot = (colour * 2654435761u) >> (32 - NEAREST_CACHE_BITS);
+
+    if (nearest_slots[slot] == 0 || nearest_colours[slot] != colour) {
+        nearest_colours[slot] = colour;
+        nearest_slots[slot] = canvas_palette_nearest(canvas_frame_palette(back), p) + 1;
+    }
+
+    pixel[0] = nearest_slots[slot] - 1;
+#else
+    pixel[0] = p.g;
+    pixel[1] = p.r;
+    pixel[2] = p.b;
+#endif
 }
 
-void canvas_render(led_strip_handle_t led_strip, const arm_config *config, int angle)
+// Sums up the colour-corrected channel values of the columns from `x0` up
+// to `x1` of a frame
+static void canvas_sum_loads(const uint8_t *frame, uint16_t *frame_loads, int x0, int x1)
 {
-    int x = (config->angle - angle + CANVAS_WIDTH) % CANVAS_WIDTH;
+    const color_lut *lut = color_lut_reference();
+
+#if CONFIG_SPOKESPICE_CANVAS_INDEXED
+    const uint8_t *palette = canvas_frame_palette((uint8_t *)frame);
+    uint16_t entry_loads[CANVAS_PALETTE_ENTRIES];
+
+    for (int i = 0; i < CANVAS_PALETTE_ENTRIES; i++, palette += 3)
+        entry_loads[i] = lut->channel[0][palette[0]] + lut->channel[1][palette[1]] + lut->channel[2][palette[2]];
 
-    for (int y = 0; y < config->num_leds; y++) {
-        int pixel_index = canvas_index(x, y);
-        led_strip_set_pixel(led_strip, y, canvas[pixel_index].r, canvas[pixel_index].g, canvas[pixel_index].b);
+    for (int x = x0; x < x1; x++) {
+        const uint8_t *pixel = canvas_frame_column((uint8_t *)frame, x);
+        uint32_t load = 0;
+
+        for (int y = 0; y < CANVAS_HEIGHT; y++)
+            load += entry_loads[pixel[y]];
+
+        frame_loads[x] = load;
     }
+#else
+    for (int x = x0; x < x1; x++) {
+        const uint8_t *pixel = canvas_frame_column((uint8_t *)frame, x);
+        uint32_t load = 0;
+
+        for (int y = 0; y < CANVAS_HEIGHT; y++, pixel += CANVAS_BYTES_PER_PIXEL)
+            load += lut->channel[0][pixel[0]] + lut->channel[1][pixel[1]] + lut->channel[2][pixel[2]];
+
+        frame_loads[x] = load;
+    }
+#endif
+}
 
-    led_strip_refresh(led_strip);
-}
\ No newline at end of file
+void canvas_compute_loads(const uint8_t *frame, uint16_t *frame_loads)
+{
+    canvas_sum_loads(frame, frame_loads, 0, CANVAS_WIDTH);
+}
+
+void canvas_set_columns(int x, int columns, const uint8_t *pixels)
+{
+    memcpy(canvas_frame_column(back, x), pixels, columns * CANVAS_COLUMN_SIZE);
+    canvas_sum_loads(back, column_loads[back_index], x, x + columns);
+}
+
+// Hands a frame over to the render task. The loads go along with it, the
+// render task only reads them once it has seen the frame.
+static void canvas_publish(const uint8_t *frame, const uint16_t *frame_loads)
+{
+    last_frame = frame;
+    last_loads = frame_loads;
+    pending_loads = frame_loads;
+
+    atomic_store_explicit(&pending, (uint8_t *)frame, memory_order_release);
+}
+
+void canvas_commit_frame()
+{
+#if CONFIG_SPOKESPICE_CANVAS_INDEXED
+    // A new palette changes the load of every column
+    if (memcmp(canvas_frame_palette(back), canvas_frame_palette((uint8_t *)last_frame), CANVAS_PALETTE_SIZE) != 0)
+        canvas_columns_changed(0, CANVAS_WIDTH);
+#endif
+
+    if (changed_x0 < changed_x1)
+        canvas_sum_loads(back, column_loads[back_index], changed_x0, changed_x1);
+
+    canvas_publish(back, column_loads[back_index]);
+    back_index ^= 1;
+}
+
+void canvas_commit_patched_frame()
+{
+    canvas_publish(back, column_loads[back_index]);
+    back_index ^= 1;
+}
+
+// The back buffer stays the same. Neither of the buffers is on display
+// once the render task has picked up the frame.
+bool canvas_present_frame(const uint8_t *frame, const uint16_t *frame_loads)
+{
+    if (canvas_frame_pending())
+        return false;
+
+    canvas_publish(frame, frame_loads);
+
+    return true;
+}
+
+bool canvas_release_presented()
+{
+    if (canvas_frame_pending())
+        return false;
+
+    if (last_frame == buffers[0] || last_frame == buffers[1])
+        return true;
+
+    // Put a copy of it on display instead
+    canvas_begin_frame();
+    canvas_commit_patched_frame();
+
+    return false;
+}
+
+bool canvas_swap()
+{
+    uint8_t *frame = atomic_load_explicit(&pending, memory_order_acquire);
+    if (frame == NULL)
+        return false;
+
+    canvas = frame;
+    loads = pending_loads;
+    atomic_store_explicit(&pending, NULL, memory_order_release);
+
+    return true;
+}
+
+// Position on the canvas for an arm, in 1/65536 columns. The columns are
+// fixed to the wheel's absolute phase, so when it turns backwards they
+// are simply walked the other way and the image doesn't get mirrored.
+static inline uint32_t canvas_position(const arm_config *config, phase_t phase)
+{
+    phase_t arm_phase = phase_from_degrees(config->angle) + config->phase_offset;
+
+    return (uint32_t)(phase_t)(arm_phase - phase) * CANVAS_WIDTH;
+}
+
+int canvas_estimate_ma(const arm_config *config, const color_lut *lut, phase_t phase)
+{
+    uint32_t position = canvas_position(config, phase);
+    int x = position >> PHASE_BITS;
+    uint32_t load = loads[x];
+
+    if (global_app_config->interpolate_columns) {
+        uint32_t fraction = (position >> (PHASE_BITS - 8)) & 0xff;
+        load = (load * (256 - fraction) + loads[(x + 1) % CANVAS_WIDTH] * fraction) >> 8;
+    }
+
+    return power_limiter_load_to_ma(load * lut->scale / 255);
+}
+
+#if CONFIG_SPOKESPICE_CANVAS_INDEXED
+// Looks a column of the front buffer up in its palette, into one of two
+// slots so that two neighbouring columns can be blended
+static const uint8_t *canvas_strip_column(int x, int slot)
+{
+    static uint8_t columns[2][CANVAS_STRIP_COLUMN_SIZE] __attribute__((aligned(16)));
+
+    const uint8_t *index = canvas_column(x);
+    const uint8_t *palette = canvas_frame_palette(canvas);
+    uint8_t *pixel = columns[slot];
+
+    for (int y = 0; y < CANVAS_HEIGHT; y++, pixel += 3) {
+        const uint8_t *entry = palette + index[y] * 3;
+
+        pixel[0] = entry[0];
+        pixel[1] = entry[1];
+        pixel[2] = entry[2];
+    }
+
+    return columns[slot];
+}
+#else
+static inline const uint8_t *canvas_strip_column(int x, int slot)
+{
+    return canvas_column(x);
+}
+#endif
+
+void canvas_render(led_strip_handle_t led_strip, const arm_config *config, const color_lut *lut, phase_t phase, int scale)
+{
+    static uint8_t column_buffer[CANVAS_STRIP_COLUMN_SIZE] __attribute__((aligned(16)));
+
+    uint32_t position = canvas_position(config, phase);
+    int x = position >> PHASE_BITS;
+    uint8_t fraction = (position >> (PHASE_BITS - 8)) & 0xff;
+    int num_leds = config->num_leds < CANVAS_HEIGHT ? config->num_leds : CANVAS_HEIGHT;
+    const uint8_t *column = canvas_strip_column(x, 0);
+
+    if (global_app_config->interpolate_columns && fraction != 0) {
+        blend_columns(column_buffer, column, canvas_strip_column((x + 1) % CANVAS_WIDTH, 1), fraction, CANVAS_STRIP_COLUMN_SIZE);
+        column = column_buffer;
+    }
+
+    if (scale < POWER_LIMITER_FULL_SCALE) {
+        color_lut_apply_scaled(lut, column_buffer, column, num_leds, scale);
+        column = column_buffer;
+    } else if (!lut->identity) {
+        color_lut_apply(lut, column_buffer, column, num_leds);
+        column = column_buffer;
+    }
+
+    led_strip_set_pixels(led_strip, 0, num_leds, column);
+}
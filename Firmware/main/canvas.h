@@ -2,22 +2,136 @@
 
 #include "led_strip.h"
 #include "app-config.h"
+#include "color-lut.h"
 
-#define CANVAS_WIDTH 360
+#include "sdkconfig.h"
+#include "utils.h"
+
+// Number of columns per revolution, see menuconfig
+#define CANVAS_WIDTH CONFIG_SPOKESPICE_CANVAS_WIDTH
 #define CANVAS_HEIGHT 32
 
+// The canvas is stored column-major, with every pixel already in the
+// GRB byte order the LED strips expect on the wire. One column of the
+// image is therefore a contiguous block that can be handed to the strip
+// as it is.
+//
+// With CONFIG_SPOKESPICE_CANVAS_INDEXED, every pixel is instead an index
+// into a palette of 256 GRB entries that is stored at the end of the
+// frame, so it travels with the frame through every copy. The render
+// pass looks the column up in the palette on its way to the strip. An
+// effect that only changes the palette leaves the pixels alone, but the
+// loads of every column are added up again when the frame is committed.
+#if CONFIG_SPOKESPICE_CANVAS_INDEXED
+#define CANVAS_BYTES_PER_PIXEL 1
+#define CANVAS_PALETTE_ENTRIES 256
+#else
+#define CANVAS_BYTES_PER_PIXEL 3
+#define CANVAS_PALETTE_ENTRIES 0
+#endif
+
+#define CANVAS_COLUMN_SIZE (CANVAS_HEIGHT * CANVAS_BYTES_PER_PIXEL)
+#define CANVAS_PALETTE_SIZE (CANVAS_PALETTE_ENTRIES * 3)
+#define CANVAS_PIXELS_SIZE (CANVAS_WIDTH * CANVAS_COLUMN_SIZE)
+#define CANVAS_SIZE (CANVAS_PIXELS_SIZE + CANVAS_PALETTE_SIZE)
+
+// A column the way it goes to the strip
+#define CANVAS_STRIP_COLUMN_SIZE (CANVAS_HEIGHT * 3)
+
 typedef struct {
     uint8_t r;
     uint8_t g;
     uint8_t b;
 } Pixel;
 
-extern Pixel *canvas;
+// The canvas is double-buffered. A producer (the GIF decoder) draws into
+// the back buffer between canvas_begin_frame() and canvas_commit_frame(),
+// and the render task picks up committed frames with canvas_swap(). The
+// hand-off is a single atomic pointer, so neither side ever blocks.
+//
+// `canvas` is the front buffer, or a frame that was presented in place.
+// It is owned by the render task and must only be read from there.
+extern uint8_t *canvas;
+
+static inline uint8_t *canvas_frame_column(uint8_t *frame, int x)
+{
+    return frame + x * CANVAS_COLUMN_SIZE;
+}
+
+static inline uint8_t *canvas_column(int x)
+{
+    return canvas_frame_column(canvas, x);
+}
+
+#if CONFIG_SPOKESPICE_CANVAS_INDEXED
+static inline uint8_t *canvas_frame_palette(uint8_t *frame)
+{
+    return frame + CANVAS_PIXELS_SIZE;
+}
+
+// Index of the palette entry closest to the given colour
+uint8_t canvas_palette_nearest(const uint8_t *palette, Pixel p);
+#endif
 
 void canvas_init();
 
 void canvas_clear();
-void canvas_set_pixel(int x, int y, Pixel p);
 void canvas_dump();
 
-void canvas_render(led_strip_handle_t led_strip, const arm_config *config, int angle);
+// Producer side. canvas_frame_pending() is true while the last committed
+// frame has not been picked up by the render task, and nothing else can
+// be committed. canvas_begin_frame() returns the back buffer, pre-filled
+// with the last committed frame, or NULL if that frame is still pending.
+// canvas_commit_frame() adds up the loads of the columns that changed in
+// the meantime: those written with canvas_set_pixel(), and those reported
+// with canvas_columns_changed() after drawing into the back buffer
+// directly. With the indexed canvas, a changed palette counts as a change
+// of every column.
+bool canvas_frame_pending();
+uint8_t *canvas_begin_frame();
+void canvas_columns_changed(int x0, int x1);
+void canvas_commit_frame();
+
+// With the indexed canvas, the colour is mapped to the nearest entry of
+// the back buffer's palette. The entries found are cached until the next
+// canvas_begin_frame(), so the palette has to be set before the pixels.
+void canvas_set_pixel(int x, int y, Pixel p);
+
+// Replaces whole columns of the back buffer, starting at column `x`, with
+// pixels in canvas layout. A frame that was only changed this way can be
+// committed with canvas_commit_patched_frame(), which skips adding up
+// the loads of the columns that stayed the same.
+void canvas_set_columns(int x, int columns, const uint8_t *pixels);
+void canvas_commit_patched_frame();
+
+// Sums up the colour-corrected channel values of every column of a frame
+// for canvas_present_frame(), see canvas_estimate_ma()
+void canvas_compute_loads(const uint8_t *frame, uint16_t *frame_loads);
+
+// Commits a complete frame that was drawn ahead of time, along with its
+// column loads. Neither is copied: the render task shows the frame from
+// where it is, so it needs the same 16-byte alignment as the buffers.
+// Both have to stay as they are until canvas_release_presented() says
+// otherwise. Returns false if the last committed frame has not been
+// picked up yet.
+bool canvas_present_frame(const uint8_t *frame, const uint16_t *frame_loads);
+
+// Gets the render task to let go of frames presented with
+// canvas_present_frame(), by putting a copy of the last one on display.
+// Returns true once it has, after which they can be freed. Until then,
+// call it again later.
+bool canvas_release_presented();
+
+// Render side. Makes the last committed frame the front buffer, if there
+// is one. Returns true if the front buffer changed.
+bool canvas_swap();
+
+// Estimated current the arm will draw for the column at the given wheel
+// phase, in milliamps, from the per-column sums of the front buffer
+int canvas_estimate_ma(const arm_config *config, const color_lut *lut, phase_t phase);
+
+// Loads the column for the given wheel phase into the strip, passing it
+// through the arm's colour tables on the way and dimming it by `scale`
+// (see power-limiter.h). The caller is responsible for refreshing the
+// strip afterwards.
+void canvas_render(led_strip_handle_t led_strip, const arm_config *config, const color_lut *lut, phase_t phase, int scale);
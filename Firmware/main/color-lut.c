@@ -0,0 +1,98 @@
+#include <math.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+
+#include "app-config.h"
+#include "color-lut.h"
+
+static const char *TAG = "color-lut";
+
+static color_lut luts[MAX_ARMS];
+static color_lut reference;
+
+static void color_lut_build(color_lut *lut, uint8_t brightness)
+{
+    const app_config *config = global_app_config;
+
+    // Channel gains in GRB order, as fractions of full scale
+    float scale = brightness / 255.0f;
+    float gain[3] = {
+        scale * config->white_balance.g / 255.0f,
+        scale * config->white_balance.r / 255.0f,
+        scale * config->white_balance.b / 255.0f,
+    };
+
+    lut->identity = true;
+    lut->scale = brightness;
+
+    for (int c = 0; c < 3; c++)
+        for (int v = 0; v < 256; v++) {
+            float corrected = powf(v / 255.0f, config->gamma) * gain[c];
+            uint8_t out = (uint8_t)lroundf(corrected * 255.0f);
+
+            lut->channel[c][v] = out;
+
+            if (out != v)
+                lut->identity = false;
+        }
+}
+
+void color_lut_rebuild()
+{
+    color_lut_build(&reference, 255);
+
+    for (int i = 0; i < MAX_ARMS; i++)
+        color_lut_build(&luts[i], global_app_config->brightness * global_app_config->arm[i].brightness / 255);
+
+    ESP_LOGI(TAG, "Colour tables rebuilt: gamma %.2f, brightness %d",
+             global_app_config->gamma, global_app_config->brightness);
+}
+
+void color_lut_init()
+{
+    color_lut_rebuild();
+}
+
+const color_lut *color_lut_for_arm(int arm)
+{
+    return &luts[arm];
+}
+
+const color_lut *color_lut_reference()
+{
+    return &reference;
+}
+
+void color_lut_apply(const color_lut *lut, uint8_t *dst, const uint8_t *src, size_t num_pixels)
+{
+    if (lut->identity) {
+        if (dst != src)
+            memcpy(dst, src, num_pixels * 3);
+        return;
+    }
+
+    const uint8_t *g = lut->channel[0];
+    const uint8_t *r = lut->channel[1];
+    const uint8_t *b = lut->channel[2];
+
+    for (size_t i = 0; i < num_pixels; i++, src += 3, dst += 3) {
+        dst[0] = g[src[0]];
+        dst[1] = r[src[1]];
+        dst[2] = b[src[2]];
+    }
+}
+
+void color_lut_apply_scaled(const color_lut *lut, uint8_t *dst, const uint8_t *src, size_t num_pixels, int scale)
+{
+    const uint8_t *g = lut->channel[0];
+    const uint8_t *r = lut->channel[1];
+    const uint8_t *b = lut->channel[2];
+
+    for (size_t i = 0; i < num_pixels; i++, src += 3, dst += 3) {
+        dst[0] = (g[src[0]] * scale) >> 8;
+        dst[1] = (r[src[1]] * scale) >> 8;
+        dst[2] = (b[src[2]] * scale) >> 8;
+    }
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "app-config.h"
+
+// Per-arm colour correction. Every arm has one 256-entry table per colour
+// channel that folds gamma, global and per-arm brightness and the white
+// balance into a single lookup. The tables are computed once, and again
+// whenever one of those settings changes, so the render path does not
+// need any per-pixel arithmetic.
+typedef struct {
+    uint8_t channel[3][256]; // in GRB order, like the canvas
+    bool identity;           // the table is a no-op and can be skipped
+    uint8_t scale;           // combined global and arm brightness, 255 = full
+} color_lut;
+
+void color_lut_init();
+
+// Recomputes all tables from the app config. Call after changing any of
+// the colour settings.
+void color_lut_rebuild();
+
+const color_lut *color_lut_for_arm(int arm);
+
+// Gamma and white balance only, at full brightness. Every arm's table is
+// this one scaled by the arm's `scale`, which is what the power limiter
+// uses to estimate the draw of a column without looking at its pixels.
+const color_lut *color_lut_reference();
+
+// Maps `num_pixels` pixels in GRB order from `src` to `dst`. The buffers
+// may be the same.
+void color_lut_apply(const color_lut *lut, uint8_t *dst, const uint8_t *src, size_t num_pixels);
+
+// Same as color_lut_apply(), with every output additionally scaled by
+// `scale` / 256
+void color_lut_apply_scaled(const color_lut *lut, uint8_t *dst, const uint8_t *src, size_t num_pixels, int scale);
@@ -0,0 +1,105 @@
+#include <stdlib.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/gptimer.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+#include "canvas.h"
+#include "column-scheduler.h"
+#include "hall-tracker.h"
+
+static const char *TAG = "scheduler";
+
+// Alarms closer than this are not worth a context switch, in microseconds
+#define MIN_SLEEP_US 20
+
+static gptimer_handle_t timer;
+static TaskHandle_t sleeping_task;
+
+static bool IRAM_ATTR column_scheduler_alarm(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *user_ctx)
+{
+    BaseType_t woken = pdFALSE;
+
+    if (sleeping_task != NULL)
+        vTaskNotifyGiveFromISR(sleeping_task, &woken);
+
+    return woken == pdTRUE;
+}
+
+void column_scheduler_init()
+{
+    gptimer_config_t config = {
+        .clk_src = GPTIMER_CLK_SRC_DEFAULT,
+        .direction = GPTIMER_COUNT_UP,
+        .resolution_hz = 1000 * 1000, // 1 tick = 1 us
+    };
+
+    ESP_ERROR_CHECK(gptimer_new_timer(&config, &timer));
+
+    gptimer_event_callbacks_t callbacks = {
+        .on_alarm = column_scheduler_alarm,
+    };
+
+    ESP_ERROR_CHECK(gptimer_register_event_callbacks(timer, &callbacks, NULL));
+    ESP_ERROR_CHECK(gptimer_enable(timer));
+    ESP_ERROR_CHECK(gptimer_start(timer));
+
+    ESP_LOGI(TAG, "Column scheduler initialized");
+}
+
+void column_scheduler_sleep_until(int64_t time_us)
+{
+    int64_t delay = time_us - esp_timer_get_time();
+
+    if (delay < MIN_SLEEP_US)
+        return;
+
+    uint64_t count;
+    gptimer_get_raw_count(timer, &count);
+
+    gptimer_alarm_config_t alarm = {
+        .alarm_count = count + delay,
+    };
+
+    sleeping_task = xTaskGetCurrentTaskHandle();
+    ulTaskNotifyTake(pdTRUE, 0);
+    gptimer_set_alarm_action(timer, &alarm);
+
+    // The timeout is only a safety net in case the alarm gets lost
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(delay / 1000) + 2);
+}
+
+int64_t column_scheduler_next_column_time(int64_t now, int steps)
+{
+    hall_tracker_state state;
+
+    if (!hall_tracker_get_state(&state))
+        return -1;
+
+    int width = CANVAS_WIDTH * steps;
+    int frequency = hall_tracker_state_frequency_at(&state, now);
+
+    if (frequency == 0)
+        return -1;
+
+    // Duration of one column (or step) at the current speed, in nanoseconds
+    int64_t column_ns = 1000000000000LL / ((int64_t)abs(frequency) * width);
+    if (column_ns <= 0)
+        return -1;
+
+    // The same extrapolation the renderer picks its column with
+    phase_t phase = hall_tracker_state_phase_at(&state, now);
+
+    // Turning forwards the phase decreases, so the next column starts
+    // once the fractional part of the current one has run down to zero.
+    // Backwards, it starts once the fractional part has filled up.
+    uint32_t fraction = ((uint32_t)phase * width) & (PHASE_FULL - 1);
+    if (frequency < 0)
+        fraction = PHASE_FULL - fraction;
+    else if (fraction == 0)
+        fraction = PHASE_FULL;
+
+    return now + (fraction * column_ns) / PHASE_FULL / 1000;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+// Interval between two pattern ticks while the wheel is not spinning, in microseconds
+#define PATTERN_TICK_INTERVAL_US 5000
+
+void column_scheduler_init();
+
+// Blocks the calling task until the given time (esp_timer base, in microseconds).
+// The wake-up comes from a hardware timer alarm, not from the FreeRTOS tick.
+void column_scheduler_sleep_until(int64_t time_us);
+
+// Predicts when the wheel will reach the next canvas column after `now`,
+// based on the hall tracker's phase and frequency. With `steps` > 1, every
+// column is further divided into that many render steps, for interpolated
+// rendering. Returns -1 if the wheel position is unknown.
+int64_t column_scheduler_next_column_time(int64_t now, int steps);
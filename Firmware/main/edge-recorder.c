@@ -0,0 +1,210 @@
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "esp_cpu.h"
+#include "esp_log.h"
+
+#include "app-config.h"
+#include "edge-recorder.h"
+#include "edge-replay.h"
+
+static const char *TAG = "recorder";
+
+// Enough for several minutes of riding. The buffer goes to PSRAM.
+#define RECORDER_CAPACITY 16384
+
+// A ride is over once no edge has come in for this long
+#define RIDE_END_US 2000000
+
+#define RECORDER_POLL_MS 500
+
+typedef struct {
+    int64_t timestamp;
+    int32_t delay;
+    uint8_t sensor;
+} recorded_edge;
+
+static recorded_edge *edges;
+static uint32_t head;    // total number of edges added
+static bool paused;      // while a recording is being written out
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+static const char *recording_dir;
+static int ride;
+
+static inline recorded_edge *edge_recorder_at(uint32_t index)
+{
+    return &edges[index % RECORDER_CAPACITY];
+}
+
+void edge_recorder_add(int sensor, int64_t timestamp, int64_t received)
+{
+    if (edges == NULL)
+        return;
+
+    portENTER_CRITICAL(&lock);
+
+    if (!paused) {
+        recorded_edge *edge = edge_recorder_at(head++);
+
+        edge->timestamp = timestamp;
+        edge->delay = received - timestamp;
+        edge->sensor = sensor;
+    }
+
+    portEXIT_CRITICAL(&lock);
+}
+
+static void edge_recorder_write(FILE *f, uint32_t first, uint32_t count)
+{
+    fprintf(f, "timestamp_us,sensor,delay_us\n");
+
+    for (uint32_t i = first; i < first + count; i++) {
+        recorded_edge *edge = edge_recorder_at(i);
+
+        fprintf(f, "%lld,%d,%ld\n", edge->timestamp, edge->sensor, edge->delay);
+    }
+}
+
+static void edge_recorder_save(uint32_t first, uint32_t count)
+{
+    if (recording_dir == NULL) {
+        edge_recorder_write(stdout, first, count);
+        return;
+    }
+
+    char path[64];
+    snprintf(path, sizeof(path), "%s/edges%03d.csv", recording_dir, ride);
+
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        ESP_LOGE(TAG, "Failed to open %s, dumping to the console instead", path);
+        edge_recorder_write(stdout, first, count);
+        return;
+    }
+
+    edge_recorder_write(f, first, count);
+    fclose(f);
+
+    ESP_LOGI(TAG, "Wrote %lu edges to %s", count, path);
+}
+
+static uint32_t edge_recorder_cycles()
+{
+    return esp_cpu_get_cycle_count();
+}
+
+static void edge_recorder_replay(uint32_t first, uint32_t count)
+{
+    edge_replay replay;
+
+    edge_replay_init(&replay, edge_recorder_cycles);
+
+    for (uint32_t i = first; i < first + count; i++) {
+        recorded_edge *edge = edge_recorder_at(i);
+
+        edge_replay_edge(&replay, edge->sensor, edge->timestamp, edge->delay);
+    }
+
+    const hall_tracker_counters *counters = &replay.filter.counters;
+
+    ESP_LOGI(TAG, "Replayed %lu edges: error %.2f degrees on average, %.2f max; "
+             "tracker delay %lld us on average, %ld max; %llu cycles per edge",
+             count, replay.errors > 0 ? replay.error_sum / replay.errors : 0, replay.error_max,
+             replay.delay_sum / count, replay.delay_max, replay.ticks / count);
+    ESP_LOGI(TAG, "Replay rejected %lu bounces and %lu outliers, inferred %lu missed edges, %lu resyncs",
+             counters->bounces, counters->outliers, counters->inferred, counters->resyncs);
+}
+
+static void edge_recorder_task_func(void *)
+{
+    while (true) {
+        vTaskDelay(pdMS_TO_TICKS(RECORDER_POLL_MS));
+
+        portENTER_CRITICAL(&lock);
+        uint32_t end = head;
+        bool over = end > 0 && esp_timer_get_time() - edge_recorder_at(end - 1)->timestamp > RIDE_END_US;
+        paused = over;
+        portEXIT_CRITICAL(&lock);
+
+        if (!over)
+            continue;
+
+        uint32_t count = end < RECORDER_CAPACITY ? end : RECORDER_CAPACITY;
+        uint32_t first = end - count;
+
+        ESP_LOGI(TAG, "Ride %d over, %lu edges recorded", ride, count);
+
+        edge_recorder_save(first, count);
+        edge_recorder_replay(first, count);
+
+        ride++;
+
+        portENTER_CRITICAL(&lock);
+        head = 0;
+        paused = false;
+        portEXIT_CRITICAL(&lock);
+    }
+}
+
+// Number of the first ride of this boot: one after the highest numbered
+// recording already in `dir`, so earlier rides aren't overwritten
+static int edge_recorder_first_ride(const char *dir)
+{
+    DIR *d = opendir(dir);
+    if (d == NULL)
+        return 0;
+
+    struct dirent *entry;
+    int next = 0;
+
+    while ((entry = readdir(d)) != NULL) {
+        // FAT may report short names in upper case
+        if (strncasecmp(entry->d_name, "edges", 5) != 0)
+            continue;
+
+        char *end;
+        long number = strtol(entry->d_name + 5, &end, 10);
+
+        if (end != entry->d_name + 5 && strcasecmp(end, ".csv") == 0 && number >= next)
+            next = number + 1;
+    }
+
+    closedir(d);
+
+    return next;
+}
+
+esp_err_t edge_recorder_init(const char *dir)
+{
+    if (!global_app_config->record_edges)
+        return ESP_OK;
+
+    recorded_edge *buffer = heap_caps_malloc(RECORDER_CAPACITY * sizeof(recorded_edge), MALLOC_CAP_SPIRAM);
+    if (buffer == NULL)
+        buffer = malloc(RECORDER_CAPACITY * sizeof(recorded_edge));
+
+    if (buffer == NULL) {
+        ESP_LOGE(TAG, "No memory for the edge recorder");
+        return ESP_ERR_NO_MEM;
+    }
+
+    recording_dir = dir;
+    edges = buffer;
+
+    if (dir != NULL)
+        ride = edge_recorder_first_ride(dir);
+
+    xTaskCreate(edge_recorder_task_func, "Edge recorder", 4096, NULL, 1, NULL);
+
+    ESP_LOGI(TAG, "Recording hall sensor edges to %s, starting at ride %d", dir != NULL ? dir : "the console", ride);
+
+    return ESP_OK;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// Records the raw hall sensor edges of a ride into a ring buffer, so
+// tracker problems seen in the field can be looked at and reproduced.
+// When the wheel has stood still for a while, the recording is written
+// to the SD card (or to the console if there is none), replayed through
+// the tracker's estimation code and cleared for the next ride.
+//
+// Recordings are CSV files named edgesNNN.csv, numbered on across boots,
+// with one edge per line: timestamp in microseconds, sensor, delay from
+// the edge until the tracker task picked it up in microseconds. On a PC,
+// they can be replayed with host/edge-replay.c.
+
+// Starts recording if app_config.record_edges is set. Recordings go to
+// `dir`, or to the console if `dir` is NULL.
+esp_err_t edge_recorder_init(const char *dir);
+
+// Adds an edge. Called from the hall tracker task.
+void edge_recorder_add(int sensor, int64_t timestamp, int64_t received);
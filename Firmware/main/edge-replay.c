@@ -0,0 +1,43 @@
+#include <math.h>
+#include <stddef.h>
+
+#include "edge-replay.h"
+
+void edge_replay_init(edge_replay *replay, edge_replay_clock clock)
+{
+    *replay = (edge_replay) { .clock = clock };
+
+    hall_tracker_filter_init(&replay->filter);
+}
+
+void edge_replay_edge(edge_replay *replay, int sensor, int64_t timestamp, int32_t delay)
+{
+    const angle_estimator *estimator = &replay->filter.estimator;
+
+    if (angle_estimator_valid(estimator)) {
+        float predicted = angle_estimator_position_at(estimator, timestamp);
+        float actual = hall_tracker_phase_to_position(hall_tracker_sensor_phase(sensor));
+        float error = fabsf(angle_estimator_wrap(predicted - actual)) * 360.0f;
+
+        replay->error_sum += error;
+        if (error > replay->error_max)
+            replay->error_max = error;
+
+        replay->errors++;
+    }
+
+    replay->delay_sum += delay;
+    if (delay > replay->delay_max)
+        replay->delay_max = delay;
+
+    replay->edges++;
+
+    if (replay->clock == NULL) {
+        hall_tracker_filter_edge(&replay->filter, sensor, timestamp);
+        return;
+    }
+
+    uint32_t start = replay->clock();
+    hall_tracker_filter_edge(&replay->filter, sensor, timestamp);
+    replay->ticks += (uint32_t)(replay->clock() - start);
+}
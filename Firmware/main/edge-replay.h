@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "hall-tracker.h"
+
+// Replays recorded hall sensor edges (see edge-recorder.h) through the
+// tracker's filter and keeps score. Before every edge, the estimate is
+// extrapolated to the time of the edge and compared with where the sensor
+// that fired actually is, which is the error the render loop would have
+// seen at that moment. Run by the edge recorder after each ride, and by
+// host/edge-replay.c on recordings copied off the SD card.
+
+// Free running counter to time the filter with, such as the CPU cycles
+typedef uint32_t (*edge_replay_clock)();
+
+typedef struct {
+    hall_tracker_filter filter;
+    edge_replay_clock clock;
+    uint32_t edges;
+    uint32_t errors;      // edges the error could be measured at
+    float error_sum;      // in degrees
+    float error_max;
+    int64_t delay_sum;    // from the edge until the tracker task picked it up, in microseconds
+    int32_t delay_max;
+    uint64_t ticks;       // of the clock, spent in the filter
+} edge_replay;
+
+// `clock` may be NULL if the filter doesn't need to be timed
+void edge_replay_init(edge_replay *replay, edge_replay_clock clock);
+
+void edge_replay_edge(edge_replay *replay, int sensor, int64_t timestamp, int32_t delay);
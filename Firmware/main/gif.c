@@ -1,13 +1,16 @@
 #include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
 #include "freertos/FreeRTOS.h"
-#include "freertos/semphr.h"
 #include "esp_timer.h"
 #include "esp_vfs.h"
+#include "esp_heap_caps.h"
 
 #include <nsgif.h>
 
 #include "canvas.h"
 #include "gif.h"
+#include "rgif2.h"
 
 #ifndef MIN
 #define MIN(a, b) ((a) < (b) ? (a) : (b))
@@ -19,11 +22,70 @@
 
 static const char *TAG = "gif";
 
-static nsgif_t *gif = NULL;
-static uint8_t *gif_buffer = NULL;
-static const nsgif_info_t *gif_info;
+// Same as libnsgif, frames that are shorter than the minimum delay get
+// the default delay
+#define MIN_DELAY_CS 2
+#define DEFAULT_DELAY_CS 10
+
+// A frame that can be presented on the canvas as it is, either decoded
+// into the frame cache at load time or stored natively in an .rgif2 file.
+// Delta frames of .rgif2 files have no pixels or loads of their own, they
+// patch the previous frame.
+typedef struct {
+    const uint8_t *pixels;
+    const uint16_t *loads;  // CANVAS_WIDTH of them, in the animation's load table
+    uint32_t delay_cs;
+} ready_frame;
+
+#if CONFIG_SPOKESPICE_FRAME_CACHE
+// PSRAM to leave free for loading the next animation
+#define FRAME_CACHE_RESERVE (512 * 1024)
+#endif
+
+#if CONFIG_SPOKESPICE_CANVAS_INDEXED
+// Finds the palette index of a decoded pixel. Slots hold a palette index
+// plus one, zero being empty.
+#define PALETTE_HASH_BITS 10
+#define PALETTE_HASH_SIZE (1 << PALETTE_HASH_BITS)
+#endif
+
+struct gif_animation {
+    // Decoder state of a GIF that is decoded on the fly, or NULL
+    nsgif_t *gif;
+    const nsgif_info_t *info;
+
+    // The file contents, as long as they are needed
+    uint8_t *buffer;
+
+    // Frames that are ready to be presented, with the .rgif2 file they
+    // come from or the frame cache holding their pixels
+    const rgif2_header *native_header;
+    ready_frame *ready_frames;
+    uint32_t ready_frame_count;
+    uint16_t *frame_loads;  // of the frames that have pixels
+#if CONFIG_SPOKESPICE_FRAME_CACHE
+    uint8_t *frame_cache;
+#endif
+
+#if CONFIG_SPOKESPICE_CANVAS_INDEXED
+    uint32_t palette_table[NSGIF_MAX_COLOURS];
+    uint32_t palette_hash_colours[PALETTE_HASH_SIZE];
+    uint16_t palette_hash_slots[PALETTE_HASH_SIZE];
+    uint32_t palette_hash_used;
+#endif
+};
+
+// Decoder task state
+static gif_animation *current = NULL;
+// Picked up, but waiting for the render task to let go of the frames of
+// `current`, which are presented in place
+static gif_animation *switching = NULL;
+static uint32_t next_ready_frame = 0;
 static uint32_t next_frame_time = 0;
 
+// Handed over by gif_play(), picked up by the decoder task
+static _Atomic(gif_animation *) incoming;
+
 static nsgif_bitmap_t *bitmap_create(int width, int height)
 {
     return calloc(width * height, 4);
@@ -58,53 +120,363 @@ static nsgif_bitmap_cb_vt bitmap_callbacks = {
     .get_rowspan = NULL
 };
 
-static SemaphoreHandle_t mutex;
-
 void gif_init()
 {
-    mutex = xSemaphoreCreateMutex();
+    atomic_init(&incoming, NULL);
+}
+
+#if CONFIG_SPOKESPICE_CANVAS_INDEXED
+static inline uint32_t palette_hash(uint32_t colour)
+{
+    return (colour * 2654435761u) >> (32 - PALETTE_HASH_BITS);
+}
+
+// Colours that aren't in the palette are added to the hash along with
+// their nearest entry, as long as this leaves enough empty slots
+#define PALETTE_HASH_MAX_USED (PALETTE_HASH_SIZE * 3 / 4)
+
+// Copies the colour table of the frame into the canvas frame's palette
+static void gif_load_palette(gif_animation *animation, uint8_t *canvas_frame, uint32_t frame)
+{
+    uint32_t *palette_hash_colours = animation->palette_hash_colours;
+    uint16_t *palette_hash_slots = animation->palette_hash_slots;
+    uint32_t *table = animation->palette_table;
+    uint8_t *palette = canvas_frame_palette(canvas_frame);
+    size_t entries = 0;
+
+    if (!nsgif_local_palette(animation->gif, frame, table, &entries))
+        nsgif_global_palette(animation->gif, table, &entries);
+
+    memset(palette, 0, CANVAS_PALETTE_SIZE);
+    memset(animation->palette_hash_slots, 0, sizeof(animation->palette_hash_slots));
+    animation->palette_hash_used = 0;
+
+    for (size_t i = 0; i < MIN(entries, CANVAS_PALETTE_ENTRIES); i++) {
+        uint32_t colour = table[i] & 0xffffff;
+        uint32_t slot = palette_hash(colour);
+
+        // R8G8B8A8 in memory, GRB on the canvas
+        palette[i * 3 + 0] = (colour >> 8)  & 0xff;
+        palette[i * 3 + 1] = (colour >> 0)  & 0xff;
+        palette[i * 3 + 2] = (colour >> 16) & 0xff;
+
+        while (palette_hash_slots[slot] != 0 && palette_hash_colours[slot] != colour)
+            slot = (slot + 1) % PALETTE_HASH_SIZE;
+
+        if (palette_hash_slots[slot] == 0) {
+            palette_hash_colours[slot] = colour;
+            palette_hash_slots[slot] = i + 1;
+            animation->palette_hash_used++;
+        }
+    }
+}
+
+static uint8_t gif_palette_index(gif_animation *animation, const uint8_t *canvas_frame, uint32_t rgba)
+{
+    uint32_t *palette_hash_colours = animation->palette_hash_colours;
+    uint16_t *palette_hash_slots = animation->palette_hash_slots;
+    uint32_t colour = rgba & 0xffffff;
+    uint32_t slot = palette_hash(colour);
+
+    while (palette_hash_slots[slot] != 0) {
+        if (palette_hash_colours[slot] == colour)
+            return palette_hash_slots[slot] - 1;
+
+        slot = (slot + 1) % PALETTE_HASH_SIZE;
+    }
+
+    // Left over from an earlier frame with a different colour table. Such
+    // pixels tend to come in areas, so the next ones find it in the hash.
+    Pixel p = { .r = rgba & 0xff, .g = (rgba >> 8) & 0xff, .b = (rgba >> 16) & 0xff };
+    uint8_t index = canvas_palette_nearest(canvas_frame_palette((uint8_t *)canvas_frame), p);
+
+    if (animation->palette_hash_used < PALETTE_HASH_MAX_USED) {
+        palette_hash_colours[slot] = colour;
+        palette_hash_slots[slot] = index + 1;
+        animation->palette_hash_used++;
+    }
+
+    return index;
 }
+#endif
 
-static esp_err_t gif_load(const void *buf, size_t size)
+// Resamples the part of a decoded image inside `rect` onto a canvas frame,
+// which changes the canvas columns from `x0` up to `x1`
+static void gif_draw(gif_animation *animation, uint8_t *canvas_frame, const uint32_t *frame_image,
+                     const nsgif_rect_t *rect, uint32_t frame, size_t *x0, size_t *x1)
 {
-    if (gif)
-        nsgif_destroy(gif);
+#if CONFIG_SPOKESPICE_CANVAS_INDEXED
+    // Every frame brings its own palette, which the pixels outside the
+    // frame rect don't index into, so the whole image is drawn
+    nsgif_rect_t full_rect = { 0, 0, animation->info->width, animation->info->height };
+
+    gif_load_palette(animation, canvas_frame, frame);
+    rect = &full_rect;
+#endif
 
-    gif = NULL;
+    // The image spans one revolution, whatever the canvas width. Resample
+    // it to the canvas columns whose source column lies in the frame rect.
+    uint32_t gif_width = animation->info->width;
+    *x0 = (rect->x0 * CANVAS_WIDTH + gif_width - 1) / gif_width;
+    *x1 = (MIN(gif_width, rect->x1) * CANVAS_WIDTH + gif_width - 1) / gif_width;
+
+    for (size_t x = *x0; x < *x1; x++) {
+        uint8_t *column = canvas_frame_column(canvas_frame, x);
+        size_t gif_x = x * gif_width / CANVAS_WIDTH;
+
+        for (size_t y = rect->y0; y < MIN(CANVAS_HEIGHT, rect->y1); y++) {
+            uint32_t rgba = frame_image[y * gif_width + gif_x];
+            uint8_t *pixel = column + y * CANVAS_BYTES_PER_PIXEL;
+
+#if CONFIG_SPOKESPICE_CANVAS_INDEXED
+            pixel[0] = gif_palette_index(animation, canvas_frame, rgba);
+#else
+            // R8G8B8A8 in memory, GRB on the canvas
+            pixel[0] = (rgba >> 8)  & 0xff;
+            pixel[1] = (rgba >> 0)  & 0xff;
+            pixel[2] = (rgba >> 16) & 0xff;
+#endif
+        }
+    }
+}
+
+void gif_close(gif_animation *animation)
+{
+    if (animation == NULL)
+        return;
+
+    if (animation->gif)
+        nsgif_destroy(animation->gif);
+
+    free(animation->ready_frames);
+    free(animation->frame_loads);
+#if CONFIG_SPOKESPICE_FRAME_CACHE
+    heap_caps_free(animation->frame_cache);
+#endif
+    heap_caps_free(animation->buffer);
+    free(animation);
+}
+
+#if CONFIG_SPOKESPICE_FRAME_CACHE
+static void gif_cache_free(gif_animation *animation)
+{
+    free(animation->ready_frames);
+    animation->ready_frames = NULL;
+    animation->ready_frame_count = 0;
+
+    free(animation->frame_loads);
+    animation->frame_loads = NULL;
+
+    heap_caps_free(animation->frame_cache);
+    animation->frame_cache = NULL;
+}
+
+// Decodes the whole animation into the frame cache, so playback doesn't
+// decode anything. Returns false if it doesn't fit into PSRAM, in which
+// case the frames are decoded on the fly.
+static bool gif_cache_build(gif_animation *animation)
+{
+    const nsgif_info_t *gif_info = animation->info;
+    uint32_t frame_count = gif_info->frame_count;
+    size_t size = frame_count * (CANVAS_SIZE + sizeof(ready_frame) + CANVAS_WIDTH * sizeof(uint16_t));
+    size_t available = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+
+    if (size > CONFIG_SPOKESPICE_FRAME_CACHE_SIZE_KB * 1024 || size + FRAME_CACHE_RESERVE > available) {
+        ESP_LOGI(TAG, "Frame cache needs %u KB, %u KB of PSRAM free, decoding on the fly",
+            size / 1024, available / 1024);
+        return false;
+    }
+
+    animation->frame_cache = heap_caps_aligned_alloc(RGIF2_FRAME_ALIGNMENT, frame_count * CANVAS_SIZE, MALLOC_CAP_SPIRAM);
+    animation->ready_frames = heap_caps_malloc(frame_count * sizeof(ready_frame), MALLOC_CAP_SPIRAM);
+    animation->frame_loads = heap_caps_malloc(frame_count * CANVAS_WIDTH * sizeof(uint16_t), MALLOC_CAP_SPIRAM);
+    if (animation->frame_cache == NULL || animation->ready_frames == NULL || animation->frame_loads == NULL) {
+        gif_cache_free(animation);
+        ESP_LOGW(TAG, "Failed to allocate %u KB for the frame cache, largest free block %u KB",
+            size / 1024, heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM) / 1024);
+        return false;
+    }
+
+    int64_t start = esp_timer_get_time();
+    nsgif_rect_t full_rect = { 0, 0, gif_info->width, gif_info->height };
+    uint32_t ready_frame_count = 0;
+    uint32_t last_frame = 0;
+
+    while (ready_frame_count < frame_count) {
+        nsgif_rect_t frame_rect;
+        nsgif_bitmap_t *bitmap;
+        uint32_t delay_cs;
+        uint32_t frame;
+
+        // Stops at the end of the animation, or when it starts over
+        nsgif_error res = nsgif_frame_prepare(animation->gif, &frame_rect, &delay_cs, &frame);
+        if (res != NSGIF_OK || (ready_frame_count > 0 && frame <= last_frame))
+            break;
+
+        // Same as on the fly, an animation loops instead of holding its last frame
+        if (delay_cs == NSGIF_INFINITE && frame_count > 1)
+            break;
+
+        res = nsgif_frame_decode(animation->gif, frame, &bitmap);
+        if (res != NSGIF_OK) {
+            ESP_LOGW(TAG, "Error decoding GIF frame %lu: %d (%s)", frame, res, nsgif_strerror(res));
+            gif_cache_free(animation);
+            return false;
+        }
+
+        uint8_t *pixels = animation->frame_cache + ready_frame_count * CANVAS_SIZE;
+        uint16_t *loads = animation->frame_loads + ready_frame_count * CANVAS_WIDTH;
+        ready_frame *ready = &animation->ready_frames[ready_frame_count++];
+
+        memset(pixels, 0, CANVAS_SIZE);
+        size_t x0, x1;
+        gif_draw(animation, pixels, (uint32_t *)bitmap, &full_rect, frame, &x0, &x1);
+        canvas_compute_loads(pixels, loads);
+        ready->pixels = pixels;
+        ready->loads = loads;
+        ready->delay_cs = delay_cs;
+        last_frame = frame;
+    }
+
+    if (ready_frame_count == 0) {
+        gif_cache_free(animation);
+        return false;
+    }
+
+    animation->ready_frame_count = ready_frame_count;
+
+    ESP_LOGI(TAG, "Cached %lu frames in %lld ms, %u KB, %u KB of PSRAM left",
+        ready_frame_count, (esp_timer_get_time() - start) / 1000,
+        ready_frame_count * (CANVAS_SIZE + sizeof(ready_frame) + CANVAS_WIDTH * sizeof(uint16_t)) / 1024, heap_caps_get_free_size(MALLOC_CAP_SPIRAM) / 1024);
+
+    return true;
+}
+#endif
+
+static esp_err_t gif_load_native(gif_animation *animation, const void *data, size_t size)
+{
+    const rgif2_header *header = data;
+    esp_err_t ret = rgif2_check(data, size);
+    if (ret != ESP_OK)
+        return ret;
+
+    if (header->bytes_per_pixel != CANVAS_BYTES_PER_PIXEL) {
+        ESP_LOGE(TAG, "RGIF2 files need the RGB canvas");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    if (header->width != CANVAS_WIDTH || header->height != CANVAS_HEIGHT) {
+        ESP_LOGE(TAG, "Converted for %dx%d, the canvas is %dx%d (convert with --width %d)",
+            header->width, header->height, CANVAS_WIDTH, CANVAS_HEIGHT, CANVAS_WIDTH);
+        return ESP_ERR_INVALID_SIZE;
+    }
 
+    // The column loads depend on the colour tables of the device, so they
+    // are worked out here, for the key frames only. The pixels stay where
+    // they are.
+    const rgif2_frame_entry *entries = rgif2_frame_table(header);
+    int key_frames = 0;
+
+    for (int i = 0; i < header->frame_count; i++)
+        if (!rgif2_frame_is_delta(header, i))
+            key_frames++;
+
+    size_t table_size = header->frame_count * sizeof(ready_frame);
+    size_t loads_size = key_frames * CANVAS_WIDTH * sizeof(uint16_t);
+    ready_frame *ready_frames = malloc(table_size);
+    uint16_t *frame_loads = malloc(loads_size);
+    if (ready_frames == NULL || frame_loads == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate frame table");
+        free(ready_frames);
+        free(frame_loads);
+        return ESP_ERR_NO_MEM;
+    }
+
+    uint16_t *loads = frame_loads;
+
+    for (int i = 0; i < header->frame_count; i++) {
+        ready_frame *ready = &ready_frames[i];
+
+        if (rgif2_frame_is_delta(header, i)) {
+            ready->pixels = NULL;
+            ready->loads = NULL;
+        } else {
+            ready->pixels = rgif2_frame_pixels(header, i);
+            ready->loads = loads;
+            canvas_compute_loads(ready->pixels, loads);
+            loads += CANVAS_WIDTH;
+        }
+
+        if (header->frame_count == 1)
+            ready->delay_cs = NSGIF_INFINITE;
+        else if (entries[i].delay_cs < MIN_DELAY_CS)
+            ready->delay_cs = DEFAULT_DELAY_CS;
+        else
+            ready->delay_cs = entries[i].delay_cs;
+    }
+
+    animation->native_header = header;
+    animation->ready_frames = ready_frames;
+    animation->ready_frame_count = header->frame_count;
+    animation->frame_loads = frame_loads;
+
+    ESP_LOGI(TAG, "RGIF2 frame_count=%u (%d delta), size %u, %u bytes of frame table and %u bytes of column loads",
+        header->frame_count, header->frame_count - key_frames, header->file_size, table_size, loads_size);
+
+    return ESP_OK;
+}
+
+static esp_err_t gif_load(gif_animation *animation, const void *buf, size_t size)
+{
     // ESP_LOG_BUFFER_HEX_LEVEL(TAG, buf, size, ESP_LOG_INFO);
 
-    nsgif_error res = nsgif_create(&bitmap_callbacks, NSGIF_BITMAP_FMT_R8G8B8A8, &gif);
+    nsgif_error res = nsgif_create(&bitmap_callbacks, NSGIF_BITMAP_FMT_R8G8B8A8, &animation->gif);
     if (res != NSGIF_OK) {
         ESP_LOGE(TAG, "Error creating GIF handler: %d (%s)", res, nsgif_strerror(res));
         return ESP_FAIL;
     }
 
-    res = nsgif_data_scan(gif, size, buf);
-    nsgif_data_complete(gif);
+    res = nsgif_data_scan(animation->gif, size, buf);
+    nsgif_data_complete(animation->gif);
 
     if (res != NSGIF_OK) {
-        nsgif_destroy(gif);
-        gif = NULL;
         ESP_LOGE(TAG, "Error loading GIF: %d (%s)", res, nsgif_strerror(res));
         return ESP_FAIL;
     }
 
-    gif_info = nsgif_get_info(gif);
+    const nsgif_info_t *gif_info = nsgif_get_info(animation->gif);
+
+    animation->info = gif_info;
     ESP_LOGI(TAG, "GIF frame_count=%lu, width=%lu, height=%lu, source size %d",
         gif_info->frame_count, gif_info->width, gif_info->height, size);
 
-    next_frame_time = 0;
+#if CONFIG_SPOKESPICE_FRAME_CACHE
+    // The cache holds everything needed for playback
+    if (gif_cache_build(animation)) {
+        nsgif_destroy(animation->gif);
+        animation->gif = NULL;
+    }
+#endif
 
     return ESP_OK;
 }
 
-esp_err_t gif_load_file(const char *path)
+static gif_animation *gif_animation_new()
+{
+    gif_animation *animation = calloc(1, sizeof(gif_animation));
+
+    if (animation == NULL)
+        ESP_LOGE(TAG, "Failed to allocate animation");
+
+    return animation;
+}
+
+gif_animation *gif_open_file(const char *path)
 {
     FILE *f = fopen(path, "r");
     if (f == NULL) {
         ESP_LOGE(TAG, "Failed to open file for reading");
-        return ESP_FAIL;
+        return NULL;
     }
 
     struct stat st;
@@ -112,58 +484,146 @@ esp_err_t gif_load_file(const char *path)
     if (err != 0) {
         ESP_LOGE(TAG, "Failed to stat file");
         fclose(f);
-        return ESP_FAIL;
+        return NULL;
     }
 
     size_t size = st.st_size;
     if (size == 0) {
         ESP_LOGE(TAG, "File is empty");
         fclose(f);
-        return ESP_FAIL;
+        return NULL;
     }
 
-    uint8_t *new_gif_buffer = malloc(size);
-    if (new_gif_buffer == NULL) {
+    gif_animation *animation = gif_animation_new();
+    if (animation == NULL) {
+        fclose(f);
+        return NULL;
+    }
+
+    // .rgif2 frames are presented straight from the buffer, so it needs
+    // their alignment
+    animation->buffer = heap_caps_aligned_alloc(RGIF2_FRAME_ALIGNMENT, size, MALLOC_CAP_DEFAULT);
+    if (animation->buffer == NULL) {
         ESP_LOGE(TAG, "Failed to allocate buffer");
         fclose(f);
-        return ESP_FAIL;
+        gif_close(animation);
+        return NULL;
     }
 
-    size_t r = fread(new_gif_buffer, 1, size, f);
+    size_t r = fread(animation->buffer, 1, size, f);
+    fclose(f);
+
     if (size != r) {
         ESP_LOGE(TAG, "Failed to read file");
-        fclose(f);
-        return ESP_FAIL;
+        gif_close(animation);
+        return NULL;
     }
 
-    fclose(f);
+    esp_err_t ret;
 
-    xSemaphoreTake(mutex, portMAX_DELAY);
+    if (size >= sizeof(rgif2_header) && memcmp(animation->buffer, RGIF2_MAGIC, 4) == 0)
+        ret = gif_load_native(animation, animation->buffer, size);
+    else
+        ret = gif_load(animation, animation->buffer, size);
 
-    esp_err_t ret = gif_load(new_gif_buffer, size);
-    free(gif_buffer);
-    gif_buffer = new_gif_buffer;
+    if (ret != ESP_OK) {
+        gif_close(animation);
+        return NULL;
+    }
+
+#if CONFIG_SPOKESPICE_FRAME_CACHE
+    // The cache holds everything needed for playback
+    if (animation->frame_cache != NULL) {
+        heap_caps_free(animation->buffer);
+        animation->buffer = NULL;
+    }
+#endif
+
+    return animation;
+}
+
+gif_animation *gif_open_mapped(const void *data, size_t size)
+{
+    gif_animation *animation = gif_animation_new();
+
+    if (animation != NULL && gif_load_native(animation, data, size) != ESP_OK) {
+        gif_close(animation);
+        return NULL;
+    }
+
+    return animation;
+}
+
+void gif_play(gif_animation *animation)
+{
+    // Replaces one that the decoder task hasn't picked up yet
+    gif_close(atomic_exchange(&incoming, animation));
+}
+
+static void gif_tick_ready(uint32_t time_cs)
+{
+    const ready_frame *ready = &current->ready_frames[next_ready_frame];
+
+    if (ready->pixels == NULL) {
+        // The back buffer starts out as the previous frame
+        if (canvas_begin_frame() == NULL)
+            return;
+
+        rgif2_delta_for_each(current->native_header, next_ready_frame, canvas_set_columns);
+        canvas_commit_patched_frame();
+    } else if (!canvas_present_frame(ready->pixels, ready->loads)) {
+        // The render task has not picked up the previous frame yet
+        return;
+    }
 
-    xSemaphoreGive(mutex);
+    if (ready->delay_cs == NSGIF_INFINITE)
+        next_frame_time = UINT32_MAX;
+    else
+        next_frame_time = time_cs + ready->delay_cs - 1;
 
-    return ret;
+    next_ready_frame = (next_ready_frame + 1) % current->ready_frame_count;
 }
 
 esp_err_t gif_tick()
 {
-    xSemaphoreTake(mutex, portMAX_DELAY);
+    gif_animation *next = atomic_exchange(&incoming, NULL);
 
-    if (!gif) {
-        xSemaphoreGive(mutex);
-        return ESP_OK;
+    if (next != NULL) {
+        gif_close(switching);
+        switching = next;
+    }
+
+    if (switching != NULL) {
+        // The render task may still be showing a frame of the current
+        // animation from the animation's own memory
+        if (!canvas_release_presented())
+            return ESP_OK;
+
+        gif_close(current);
+        current = switching;
+        switching = NULL;
+        next_ready_frame = 0;
+        next_frame_time = 0;
     }
 
+    if (current == NULL)
+        return ESP_OK;
+
     uint32_t time_cs = esp_timer_get_time() / 10000;
-    if (time_cs < next_frame_time) {
-        xSemaphoreGive(mutex);
+    if (time_cs < next_frame_time)
+        return ESP_OK;
+
+    if (current->ready_frame_count > 0) {
+        gif_tick_ready(time_cs);
         return ESP_OK;
     }
-    
+
+    // The render task has not picked up the previous frame yet
+    if (canvas_frame_pending())
+        return ESP_OK;
+
+    nsgif_t *gif = current->gif;
+
     nsgif_rect_t frame_rect;
     uint32_t delay_cs;
     uint32_t frame;
@@ -174,18 +634,16 @@ esp_err_t gif_tick()
 
     if (res != NSGIF_OK) {
         ESP_LOGW(TAG, "Error preparing GIF frame: %d (%s)", res, nsgif_strerror(res));
-        xSemaphoreGive(mutex);
         return ESP_FAIL;
     }
 
     if (delay_cs == NSGIF_INFINITE) {
-        if (gif_info->frame_count > 1) {
+        if (current->info->frame_count > 1) {
             ESP_LOGD(TAG, "GIF animation end, looping");
             nsgif_reset(gif);
 
             next_frame_time = time_cs;
 
-            xSemaphoreGive(mutex);
             return ESP_OK;
         } else {
             next_frame_time = UINT32_MAX;
@@ -198,29 +656,22 @@ esp_err_t gif_tick()
     res = nsgif_frame_decode(gif, frame, &bitmap);
     if (res != NSGIF_OK) {
         ESP_LOGW(TAG, "Error decoding GIF frame: %d (%s)", res, nsgif_strerror(res));
-        xSemaphoreGive(mutex);
         return ESP_FAIL;
     }
 
-    uint32_t *frame_image = (uint32_t *)bitmap;
-
-    for (size_t x = frame_rect.x0; x < MIN(CANVAS_WIDTH, frame_rect.x1); x++)
-        for (size_t y = frame_rect.y0; y < MIN(CANVAS_HEIGHT, frame_rect.y1); y++) {
-            size_t offs = y * gif_info->width + x;
-
-            Pixel p = {
-                .r = (frame_image[offs] >> 0)  & 0xff,
-                .g = (frame_image[offs] >> 8)  & 0xff,
-                .b = (frame_image[offs] >> 16) & 0xff
-            };
+    // Only now that there is a frame to draw, as it copies the whole canvas
+    uint8_t *canvas_frame = canvas_begin_frame();
+    if (canvas_frame == NULL)
+        return ESP_OK;
 
-            canvas_set_pixel(x, y, p);
-        }
+    size_t x0, x1;
+    gif_draw(current, canvas_frame, (uint32_t *)bitmap, &frame_rect, frame, &x0, &x1);
+    canvas_columns_changed(x0, x1);
 
     // ESP_LOGI(TAG, "Rendered frame %lu  x %08lx", frame, frame_image[0]);
     // canvas_dump();
 
-    xSemaphoreGive(mutex);
+    canvas_commit_frame();
 
     return ESP_OK;
 }
\ No newline at end of file
@@ -5,6 +5,20 @@
 
 #include "canvas.h"
 
+// An animation that is loaded and ready to be played
+typedef struct gif_animation gif_animation;
+
 void gif_init();
-esp_err_t gif_load_file(const char *path);
+
+// Loading doesn't touch the animation that is playing, so it can happen in
+// any task. Both return NULL on failure.
+gif_animation *gif_open_file(const char *path);
+// Plays an .rgif2 file straight from memory, usually mapped from flash.
+// The data must stay in place until the animation is closed.
+gif_animation *gif_open_mapped(const void *data, size_t size);
+void gif_close(gif_animation *animation);
+
+// Hands the animation over to the decoder task, which switches to it on its
+// next tick and closes the previous one. Never blocks.
+void gif_play(gif_animation *animation);
 esp_err_t gif_tick();
@@ -0,0 +1,57 @@
+#include "gyro-fusion.h"
+
+void gyro_fusion_init(gyro_fusion *fusion, const gyro_fusion_config *config)
+{
+    fusion->config = *config;
+    fusion->bias = 0;
+    fusion->last_sample = 0;
+    fusion->last_edge = 0;
+}
+
+bool gyro_fusion_active(const gyro_fusion *fusion, const angle_estimator *estimator, int64_t now)
+{
+    return angle_estimator_valid(estimator) && fusion->last_sample > 0 &&
+           now - fusion->last_sample <= fusion->config.max_sample_age_us;
+}
+
+void gyro_fusion_sample(gyro_fusion *fusion, angle_estimator *estimator, int64_t timestamp, float rate)
+{
+    fusion->last_sample = timestamp;
+
+    // Nothing to propagate until the hall edges have given us a position
+    if (!angle_estimator_valid(estimator) || timestamp <= estimator->propagated_at)
+        return;
+
+    float corrected = rate - fusion->bias;
+    float dt = (timestamp - estimator->propagated_at) * 1e-6f;
+
+    // Trapezoidal integration between the previous rate and this one
+    estimator->position = angle_estimator_normalize(estimator->position + 0.5f * (estimator->velocity + corrected) * dt);
+    estimator->velocity = corrected;
+    estimator->acceleration = 0;
+
+    // The time of the last edge stays, the estimator measures the next
+    // interval from it if the gyro drops out
+    estimator->propagated_at = timestamp;
+}
+
+void gyro_fusion_edge(gyro_fusion *fusion, angle_estimator *estimator, int64_t timestamp, float position)
+{
+    float predicted = angle_estimator_position_at(estimator, timestamp);
+    float residual = angle_estimator_wrap(position - predicted);
+
+    estimator->position = angle_estimator_normalize(predicted + fusion->config.alpha * residual);
+    estimator->interval = timestamp - estimator->timestamp;
+    estimator->timestamp = timestamp;
+    estimator->propagated_at = timestamp;
+    estimator->residual = residual;
+    estimator->edges++;
+
+    // A gyro that reads high makes the estimate run ahead of the edges.
+    // Spread the residual over the time since the last edge to get at the
+    // rate error.
+    if (fusion->last_edge > 0 && timestamp > fusion->last_edge)
+        fusion->bias -= fusion->config.bias_gain * residual / ((timestamp - fusion->last_edge) * 1e-6f);
+
+    fusion->last_edge = timestamp;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "angle-estimator.h"
+
+// Fuses the angular rate from a gyroscope into the angle estimate. Between
+// hall edges the estimate is propagated by integrating the measured rate,
+// so it follows the wheel speeding up or slowing down within a quarter
+// turn, where the estimator alone could only extrapolate. The hall edges
+// still pin down the absolute position, and the differences between the
+// two are used to track the gyro's bias.
+//
+// Rates are in revolutions per second, in the estimator's direction. Like
+// the estimator, this has no dependencies on the ESP-IDF, so it can also
+// be fed with recorded or synthetic traces on a host, see
+// host/gyro-fusion-test.c.
+
+typedef struct {
+    float alpha;      // share of the residual corrected at a hall edge
+    float bias_gain;  // how quickly the bias estimate follows the residuals
+    int64_t max_sample_age_us;  // the gyro is ignored if its data gets older than this
+} gyro_fusion_config;
+
+#define GYRO_FUSION_DEFAULT_CONFIG() { \
+    .alpha = 0.5f,                     \
+    .bias_gain = 0.2f,                 \
+    .max_sample_age_us = 20000,        \
+}
+
+typedef struct {
+    gyro_fusion_config config;
+    float bias;           // in revolutions per second
+    int64_t last_sample;
+    int64_t last_edge;
+} gyro_fusion;
+
+void gyro_fusion_init(gyro_fusion *fusion, const gyro_fusion_config *config);
+
+// True if the gyro is currently driving the estimate
+bool gyro_fusion_active(const gyro_fusion *fusion, const angle_estimator *estimator, int64_t now);
+
+// Propagates the estimate to the time of a rate sample
+void gyro_fusion_sample(gyro_fusion *fusion, angle_estimator *estimator, int64_t timestamp, float rate);
+
+// Corrects the estimate and the gyro bias with a hall edge. Only use this
+// while gyro_fusion_active(), otherwise use angle_estimator_update().
+void gyro_fusion_edge(gyro_fusion *fusion, angle_estimator *estimator, int64_t timestamp, float position);
@@ -0,0 +1,280 @@
+#include "freertos/FreeRTOS.h"
+#include "driver/gpio.h"
+#include "driver/mcpwm_cap.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "esp_check.h"
+
+#include "app-config.h"
+#include "hall-capture.h"
+#include "hall-tracker.h"
+
+static const char *TAG = "hall-capture";
+
+// An MCPWM group has three capture channels. Two of them take hall
+// sensors, the third one is triggered by software to relate the group's
+// capture timer to the esp_timer clock.
+#define CAPTURE_GROUPS 2
+#define SENSORS_PER_GROUP 2
+
+// The capture timer wraps after a minute at 80 MHz. Resyncing much more
+// often than that keeps the conversion well within range.
+#define SYNC_INTERVAL_US 1000000
+
+#define COMPARE_REPORT_INTERVAL_US 2000000
+
+// The ISR timestamp of an edge comes after its capture timestamp, by less
+// than this. Otherwise the two can't be the same edge.
+#define COMPARE_MAX_DIFFERENCE_US 1000
+
+typedef struct {
+    mcpwm_cap_timer_handle_t timer;
+    mcpwm_cap_channel_handle_t reference;
+    uint32_t ticks_per_us;
+
+    // A capture timer count and the esp_timer time it corresponds to
+    uint32_t reference_count;
+    int64_t reference_time;
+    int64_t pending_reference_time;
+} capture_group;
+
+typedef struct {
+    capture_group *group;
+    mcpwm_cap_channel_handle_t channel;
+    const arm_config *arm;
+    int index;
+
+    // Instrumentation: the timestamp of an edge that has been seen by one
+    // side but not yet by the other
+    int64_t pending_capture;
+    int64_t pending_isr;
+} capture_sensor;
+
+typedef struct {
+    uint32_t edges;
+    int64_t sum;
+    int min;
+    int max;
+} compare_stats;
+
+static capture_group groups[CAPTURE_GROUPS];
+static capture_sensor sensors[MAX_ARMS];
+static portMUX_TYPE sync_lock = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t sync_timer;
+
+#if CONFIG_SPOKESPICE_HALL_CAPTURE_COMPARE
+static compare_stats stats = { .min = INT32_MAX, .max = INT32_MIN };
+static int64_t last_report;
+
+static void IRAM_ATTR hall_capture_compare_add(int difference)
+{
+    portENTER_CRITICAL_ISR(&sync_lock);
+
+    stats.edges++;
+    stats.sum += difference;
+
+    if (difference < stats.min)
+        stats.min = difference;
+
+    if (difference > stats.max)
+        stats.max = difference;
+
+    portEXIT_CRITICAL_ISR(&sync_lock);
+}
+
+static inline bool IRAM_ATTR hall_capture_compare_match(int64_t isr_time, int64_t capture_time)
+{
+    int64_t difference = isr_time - capture_time;
+
+    return difference >= 0 && difference < COMPARE_MAX_DIFFERENCE_US;
+}
+
+static void IRAM_ATTR hall_capture_compare_isr(void *args)
+{
+    capture_sensor *sensor = (capture_sensor *)args;
+    int64_t now = esp_timer_get_time();
+
+    if (sensor->pending_capture != 0 && hall_capture_compare_match(now, sensor->pending_capture)) {
+        hall_capture_compare_add(now - sensor->pending_capture);
+        sensor->pending_capture = 0;
+    } else {
+        // A capture that didn't match has missed its ISR
+        sensor->pending_capture = 0;
+        sensor->pending_isr = now;
+    }
+}
+
+static void hall_capture_compare_report(int64_t now)
+{
+    if (now - last_report < COMPARE_REPORT_INTERVAL_US)
+        return;
+
+    last_report = now;
+
+    portENTER_CRITICAL(&sync_lock);
+    compare_stats s = stats;
+    stats = (compare_stats) { .min = INT32_MAX, .max = INT32_MIN };
+    portEXIT_CRITICAL(&sync_lock);
+
+    if (s.edges == 0)
+        return;
+
+    ESP_LOGI(TAG, "ISR timestamps lag capture by %lld us on average (min %d, max %d, %lu edges)",
+             s.sum / s.edges, s.min, s.max, s.edges);
+}
+#endif
+
+static bool IRAM_ATTR hall_capture_reference_cb(mcpwm_cap_channel_handle_t channel, const mcpwm_capture_event_data_t *edata, void *user_ctx)
+{
+    capture_group *group = (capture_group *)user_ctx;
+
+    group->reference_count = edata->cap_value;
+    group->reference_time = group->pending_reference_time;
+
+    return false;
+}
+
+static bool IRAM_ATTR hall_capture_edge_cb(mcpwm_cap_channel_handle_t channel, const mcpwm_capture_event_data_t *edata, void *user_ctx)
+{
+    capture_sensor *sensor = (capture_sensor *)user_ctx;
+    capture_group *group = sensor->group;
+
+    // The callbacks of one group share an interrupt, so the reference
+    // can't change underneath us here
+    int32_t ticks = (int32_t)(edata->cap_value - group->reference_count);
+    int64_t timestamp = group->reference_time + ticks / (int32_t)group->ticks_per_us;
+
+#if CONFIG_SPOKESPICE_HALL_CAPTURE_COMPARE
+    if (sensor->pending_isr != 0 && hall_capture_compare_match(sensor->pending_isr, timestamp)) {
+        hall_capture_compare_add(sensor->pending_isr - timestamp);
+        sensor->pending_isr = 0;
+    } else {
+        // An ISR timestamp that didn't match belongs to an edge that
+        // wasn't captured
+        sensor->pending_isr = 0;
+        sensor->pending_capture = timestamp;
+    }
+#endif
+
+    hall_tracker_trigger_at(sensor->index, timestamp);
+
+    return false;
+}
+
+static void hall_capture_sync(void *)
+{
+    for (int i = 0; i < CAPTURE_GROUPS; i++) {
+        capture_group *group = &groups[i];
+
+        if (group->timer == NULL)
+            continue;
+
+        // The soft catch latches the timer right away, so the time taken
+        // just before it belongs to the captured count
+        portENTER_CRITICAL(&sync_lock);
+        group->pending_reference_time = esp_timer_get_time();
+        mcpwm_capture_channel_trigger_soft_catch(group->reference);
+        portEXIT_CRITICAL(&sync_lock);
+    }
+
+#if CONFIG_SPOKESPICE_HALL_CAPTURE_COMPARE
+    hall_capture_compare_report(esp_timer_get_time());
+#endif
+}
+
+static esp_err_t hall_capture_group_init(capture_group *group, int group_id)
+{
+    mcpwm_capture_timer_config_t timer_config = {
+        .group_id = group_id,
+        .clk_src = MCPWM_CAPTURE_CLK_SRC_DEFAULT,
+    };
+
+    ESP_RETURN_ON_ERROR(mcpwm_new_capture_timer(&timer_config, &group->timer), TAG, "Failed to create capture timer");
+
+    uint32_t resolution;
+    ESP_RETURN_ON_ERROR(mcpwm_capture_timer_get_resolution(group->timer, &resolution), TAG, "Failed to get timer resolution");
+    group->ticks_per_us = resolution / 1000000;
+
+    mcpwm_capture_channel_config_t channel_config = {
+        .gpio_num = -1,
+        .prescale = 1,
+        .flags.pos_edge = true,
+    };
+
+    ESP_RETURN_ON_ERROR(mcpwm_new_capture_channel(group->timer, &channel_config, &group->reference), TAG, "Failed to create reference channel");
+
+    mcpwm_capture_event_callbacks_t callbacks = {
+        .on_cap = hall_capture_reference_cb,
+    };
+
+    ESP_RETURN_ON_ERROR(mcpwm_capture_channel_register_event_callbacks(group->reference, &callbacks, group), TAG, "Failed to register callback");
+    ESP_RETURN_ON_ERROR(mcpwm_capture_channel_enable(group->reference), TAG, "Failed to enable reference channel");
+    ESP_RETURN_ON_ERROR(mcpwm_capture_timer_enable(group->timer), TAG, "Failed to enable capture timer");
+    ESP_RETURN_ON_ERROR(mcpwm_capture_timer_start(group->timer), TAG, "Failed to start capture timer");
+
+    return ESP_OK;
+}
+
+static esp_err_t hall_capture_sensor_init(capture_sensor *sensor, capture_group *group, int index)
+{
+    const arm_config *arm = &global_app_config->arm[index];
+
+    sensor->group = group;
+    sensor->arm = arm;
+    sensor->index = index;
+
+    mcpwm_capture_channel_config_t channel_config = {
+        .gpio_num = arm->hall_sensor_pin,
+        .prescale = 1,
+        .flags.neg_edge = true,
+        .flags.pull_up = true,
+    };
+
+    ESP_RETURN_ON_ERROR(mcpwm_new_capture_channel(group->timer, &channel_config, &sensor->channel), TAG, "Failed to create capture channel");
+
+    mcpwm_capture_event_callbacks_t callbacks = {
+        .on_cap = hall_capture_edge_cb,
+    };
+
+    ESP_RETURN_ON_ERROR(mcpwm_capture_channel_register_event_callbacks(sensor->channel, &callbacks, sensor), TAG, "Failed to register callback");
+
+#if CONFIG_SPOKESPICE_HALL_CAPTURE_COMPARE
+    ESP_RETURN_ON_ERROR(gpio_set_intr_type(arm->hall_sensor_pin, GPIO_INTR_NEGEDGE), TAG, "Failed to set interrupt type");
+    ESP_RETURN_ON_ERROR(gpio_isr_handler_add(arm->hall_sensor_pin, hall_capture_compare_isr, sensor), TAG, "Failed to add ISR");
+#endif
+
+    return ESP_OK;
+}
+
+esp_err_t hall_capture_init()
+{
+    for (int i = 0; i < CAPTURE_GROUPS; i++)
+        ESP_RETURN_ON_ERROR(hall_capture_group_init(&groups[i], i), TAG, "Failed to set up MCPWM group %d", i);
+
+    // The reference has to be in place before the first edge comes in
+    hall_capture_sync(NULL);
+
+    esp_timer_create_args_t timer_args = {
+        .callback = hall_capture_sync,
+        .name = "hall capture sync",
+    };
+
+    ESP_RETURN_ON_ERROR(esp_timer_create(&timer_args, &sync_timer), TAG, "Failed to create sync timer");
+    ESP_RETURN_ON_ERROR(esp_timer_start_periodic(sync_timer, SYNC_INTERVAL_US), TAG, "Failed to start sync timer");
+
+    for (int i = 0; i < MAX_ARMS; i++) {
+        if (global_app_config->arm[i].hall_sensor_pin < 0)
+            continue;
+
+        ESP_RETURN_ON_ERROR(hall_capture_sensor_init(&sensors[i], &groups[i / SENSORS_PER_GROUP], i), TAG, "Failed to set up sensor %d", i);
+    }
+
+    // Only let edges through once everything is wired up
+    for (int i = 0; i < MAX_ARMS; i++)
+        if (sensors[i].channel != NULL)
+            ESP_RETURN_ON_ERROR(mcpwm_capture_channel_enable(sensors[i].channel), TAG, "Failed to enable capture channel");
+
+    ESP_LOGI(TAG, "Capturing hall sensor edges with MCPWM, %lu ticks per us", groups[0].ticks_per_us);
+
+    return ESP_OK;
+}
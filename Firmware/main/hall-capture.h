@@ -0,0 +1,15 @@
+#pragma once
+
+#include "esp_err.h"
+
+// Hall sensor edges timestamped in hardware by the MCPWM capture units,
+// instead of reading the clock in a GPIO interrupt handler. The capture
+// timer latches the edge the moment it arrives, so the timestamp does not
+// depend on how long the interrupt takes to get dispatched. Edges go to
+// the hall tracker through hall_tracker_trigger_at().
+//
+// With CONFIG_SPOKESPICE_HALL_CAPTURE_COMPARE, a GPIO interrupt on the same
+// pins timestamps every edge the old way as well, and the difference
+// between the two is logged periodically.
+
+esp_err_t hall_capture_init();
@@ -0,0 +1,163 @@
+#include <math.h>
+#include <string.h>
+
+#include "esp_log.h"
+
+#include "app-config.h"
+#include "hall-tracker.h"
+
+static const char *TAG = "hall";
+
+// A sensor firing again sooner than this is bouncing, whatever the speed
+#define BOUNCE_US 2000
+
+// Edges whose position differs from the prediction by more than this,
+// in revolutions, don't fit the estimate. That is half the spacing of
+// four sensors, so an edge can't be mistaken for a neighbouring sensor.
+#define EDGE_GATE 0.125f
+
+// Until the estimate has this many edges, its speed comes from one or
+// two intervals, which is too rough for EDGE_GATE while the wheel spins up.
+// The next sensor is taken instead, as long as the interval is within
+// MAX_INTERVAL_RATIO of the previous one either way.
+#define GATE_EDGES 4
+#define MAX_INTERVAL_RATIO 3
+
+// After this many rejected edges in a row, the estimate is more likely to
+// be wrong than the edges, and the estimator starts over
+#define MAX_CONSECUTIVE_REJECTS 3
+
+// Gaps between edges up to this long are bridged by the estimator, so a
+// missed magnet at low speed doesn't lose the lock, in microseconds
+#define MAX_EDGE_GAP_US 1000000
+
+// Where the sensor actually is, including its learned mounting offset
+phase_t hall_tracker_sensor_phase(int sensor) {
+    const arm_config *arm = &global_app_config->arm[sensor];
+
+    return phase_from_degrees(arm->angle) + arm->phase_offset;
+}
+
+float hall_tracker_phase_to_position(phase_t phase) {
+    return -(float)phase / PHASE_FULL;
+}
+
+void hall_tracker_filter_init(hall_tracker_filter *filter) {
+    angle_estimator_config config = ANGLE_ESTIMATOR_DEFAULT_CONFIG();
+
+    gyro_fusion_config fusion_config = GYRO_FUSION_DEFAULT_CONFIG();
+
+    config.max_interval_us = MAX_EDGE_GAP_US;
+    angle_estimator_init(&filter->estimator, &config);
+    gyro_fusion_init(&filter->fusion, &fusion_config);
+
+    filter->last_sensor = -1;
+    filter->last_angle = 0;
+    filter->angle_delta = 0;
+    filter->last_timestamp = 0;
+    filter->consecutive_rejects = 0;
+    filter->sensors = 0;
+
+    for (int i = 0; i < MAX_ARMS; i++)
+        if (global_app_config->arm[i].hall_sensor_pin >= 0)
+            filter->sensors++;
+
+    memset(&filter->counters, 0, sizeof(filter->counters));
+}
+
+// How far the wheel has turned from the last sensor to this one, in the
+// direction of rotation, leaving out whole revolutions
+static float hall_tracker_filter_gap(const hall_tracker_filter *filter, float position) {
+    float last_position = hall_tracker_phase_to_position(hall_tracker_sensor_phase(filter->last_sensor));
+    float gap = angle_estimator_normalize(position - last_position);
+
+    return filter->estimator.velocity < 0 && gap > 0 ? 1.0f - gap : gap;
+}
+
+// An edge of the next sensor that comes about when the last interval
+// says, while the estimate is too young to judge it
+static bool hall_tracker_filter_plausible(const hall_tracker_filter *filter, float position, int64_t interval) {
+    int64_t last_interval = filter->estimator.interval;
+
+    if (filter->estimator.edges >= GATE_EDGES || last_interval <= 0)
+        return false;
+
+    return fabsf(hall_tracker_filter_gap(filter, position) - 1.0f / filter->sensors) < EDGE_GATE &&
+           interval * MAX_INTERVAL_RATIO >= last_interval && interval <= last_interval * MAX_INTERVAL_RATIO;
+}
+
+// Checks an edge against the estimate. Returns false if it should be
+// dropped, and may restart the estimator if the edges keep disagreeing.
+static bool hall_tracker_filter_validate(hall_tracker_filter *filter, int sensor, int64_t timestamp, float position) {
+    angle_estimator *estimator = &filter->estimator;
+    int64_t interval = timestamp - filter->last_timestamp;
+    bool valid = angle_estimator_valid(estimator) && interval <= MAX_EDGE_GAP_US;
+
+    // The same sensor again is fine after a revolution (if the others
+    // went missing), but not right away
+    if (sensor == filter->last_sensor) {
+        int64_t revolution = valid && estimator->velocity != 0 ? (int64_t)(1e6f / fabsf(estimator->velocity)) : 0;
+
+        if (interval < BOUNCE_US || interval < revolution / 2) {
+            filter->counters.bounces++;
+            return false;
+        }
+    }
+
+    if (!valid)
+        return true;
+
+    float residual = angle_estimator_wrap(position - angle_estimator_position_at(estimator, timestamp));
+
+    if (fabsf(residual) > EDGE_GATE && !hall_tracker_filter_plausible(filter, position, interval)) {
+        if (++filter->consecutive_rejects < MAX_CONSECUTIVE_REJECTS) {
+            filter->counters.outliers++;
+            return false;
+        }
+
+        ESP_LOGW(TAG, "Edges keep disagreeing with the estimate, starting over");
+        angle_estimator_reset(estimator);
+        filter->counters.resyncs++;
+        filter->consecutive_rejects = 0;
+        return true;
+    }
+
+    filter->consecutive_rejects = 0;
+
+    // Edges we should have seen on the way here went missing. The
+    // estimator copes with the longer interval by itself. The gap between
+    // the sensors is known, the speed only has to tell how many whole
+    // revolutions there were on top, so it can be rough.
+    float gap = hall_tracker_filter_gap(filter, position);
+    float travel = fabsf(estimator->velocity) * (interval * 1e-6f);
+    int passed = (int)lroundf((gap + fmaxf(0, roundf(travel - gap))) * filter->sensors);
+    if (passed > 1)
+        filter->counters.inferred += passed - 1;
+
+    return true;
+}
+
+bool hall_tracker_filter_edge(hall_tracker_filter *filter, int sensor, int64_t timestamp) {
+    float position = hall_tracker_phase_to_position(hall_tracker_sensor_phase(sensor));
+
+    if (!hall_tracker_filter_validate(filter, sensor, timestamp, position))
+        return false;
+
+    int angle = global_app_config->arm[sensor].angle;
+    int angle_delta = (angle - filter->last_angle + 360) % 360;
+
+    if (angle_delta > 180)
+        angle_delta -= 360;
+
+    if (gyro_fusion_active(&filter->fusion, &filter->estimator, timestamp))
+        gyro_fusion_edge(&filter->fusion, &filter->estimator, timestamp, position);
+    else
+        angle_estimator_update(&filter->estimator, timestamp, position);
+
+    filter->last_sensor = sensor;
+    filter->last_angle = angle;
+    filter->angle_delta = angle_delta;
+    filter->last_timestamp = timestamp;
+
+    return true;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "hall-tracker.h"
+
+// The tracker's estimate, as published to readers. The tracker task is
+// the only writer. Readers on either core take a consistent copy with
+// hall_tracker_snapshot_read() and never block: the sequence counter is
+// odd while an update is in progress, and a reader retries if it changed
+// underneath it.
+typedef struct {
+    int64_t timestamp; // of the estimate, in microseconds
+    phase_t phase;     // estimated phase at that time
+    int angle_delta;   // between the last two edges, in degrees
+    int frequency;     // in millihertz, negative when turning backwards
+    float acceleration; // in revolutions per second squared
+    bool valid;
+    int sensors;       // number of sensors fitted
+    hall_tracker_counters counters;
+} hall_tracker_snapshot;
+
+typedef struct {
+    atomic_uint sequence;
+    hall_tracker_snapshot snapshot;
+} hall_tracker_seqlock;
+
+// Only ever called from one task at a time
+static inline void hall_tracker_snapshot_write(hall_tracker_seqlock *lock, const hall_tracker_snapshot *update) {
+    unsigned int sequence = atomic_load_explicit(&lock->sequence, memory_order_relaxed);
+
+    atomic_store_explicit(&lock->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    *(volatile hall_tracker_snapshot *)&lock->snapshot = *update;
+
+    atomic_store_explicit(&lock->sequence, sequence + 2, memory_order_release);
+}
+
+static inline void hall_tracker_snapshot_read(hall_tracker_seqlock *lock, hall_tracker_snapshot *out) {
+    unsigned int before, after;
+
+    do {
+        before = atomic_load_explicit(&lock->sequence, memory_order_acquire);
+        if (before & 1)
+            continue;
+
+        *out = *(volatile hall_tracker_snapshot *)&lock->snapshot;
+
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&lock->sequence, memory_order_relaxed);
+    } while ((before & 1) || before != after);
+}
@@ -1,159 +1,308 @@
+#include <math.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/semphr.h"
 #include "freertos/queue.h"
 
 #include "esp_timer.h"
 #include "esp_log.h"
 
+#include "angle-estimator.h"
 #include "app-config.h"
+#include "edge-recorder.h"
 #include "hall-tracker.h"
+#include "hall-tracker-snapshot.h"
+#include "rotation-sim.h"
+#include "sensor-calibration.h"
 #include "utils.h"
 
 static const char *TAG = "hall";
 
-static int64_t last_timestamp; // in microseconds
-static int last_angle;         // in degrees
-static int last_angle_delta;   // in degrees
-static int frequency;          // in millihertz
+static hall_tracker_seqlock published;
 
 const int min_frequency = 1000;  // in millihertz
 const int max_time_delta = 500; // in milliseconds
 
-#define FREQ_MOVING_AVG_SIZE 10
-static int freq_moving_avg[FREQ_MOVING_AVG_SIZE];
-static int freq_moving_avg_index = 0;
+// The wheel position stays known for LOCK_EDGE_INTERVALS_NUM /
+// LOCK_EDGE_INTERVALS_DEN expected edge intervals without an edge, or at
+// least max_time_delta
+#define LOCK_EDGE_INTERVALS_NUM 5
+#define LOCK_EDGE_INTERVALS_DEN 2
 
 static QueueHandle_t queue;
-static SemaphoreHandle_t mutex;
+
+// Sensor index of gyro samples in the queue
+#define GYRO_EVENT -1
 
 struct hall_tracker_trigger_event {
     uint64_t timestamp;
-    int angle;
+    int sensor;
+    float rate;  // of gyro samples, in revolutions per second
 };
 
-void IRAM_ATTR hall_tracker_trigger(int angle) {
+void IRAM_ATTR hall_tracker_trigger(int sensor) {
+    hall_tracker_trigger_at(sensor, esp_timer_get_time());
+}
+
+void IRAM_ATTR hall_tracker_trigger_at(int sensor, int64_t timestamp) {
     struct hall_tracker_trigger_event event = {
-        .timestamp = esp_timer_get_time(),
-        .angle = angle
+        .timestamp = timestamp,
+        .sensor = sensor
     };
 
     xQueueSendFromISR(queue, &event, NULL);
 }
 
+void hall_tracker_feed(int sensor, int64_t timestamp) {
+    struct hall_tracker_trigger_event event = {
+        .timestamp = timestamp,
+        .sensor = sensor
+    };
+
+    xQueueSend(queue, &event, portMAX_DELAY);
+}
+
+void hall_tracker_gyro_sample(int64_t timestamp, float rate) {
+    struct hall_tracker_trigger_event event = {
+        .timestamp = timestamp,
+        .sensor = GYRO_EVENT,
+        .rate = rate
+    };
+
+    // Better to lose a sample than to hold up the IMU
+    xQueueSend(queue, &event, 0);
+}
+
+static phase_t hall_tracker_position_to_phase(float position) {
+    return (phase_t)(-(int32_t)(position * PHASE_FULL));
+}
+
 void hall_tracker_task_func(void *pvParameter) {
     struct hall_tracker_trigger_event event;
 
+    // Working state, only touched by this task
+    hall_tracker_filter filter;
+    hall_tracker_snapshot state = {};
+    bool backwards = false;
+
+    hall_tracker_filter_init(&filter);
+
     while (true) {
         if (!xQueueReceive(queue, &event, portMAX_DELAY))
             continue;
 
-        int f;
+        if (event.sensor == GYRO_EVENT) {
+            gyro_fusion_sample(&filter.fusion, &filter.estimator, event.timestamp, event.rate);
+
+            if (!angle_estimator_valid(&filter.estimator))
+                continue;
+        } else {
+            edge_recorder_add(event.sensor, event.timestamp, esp_timer_get_time());
+
+            if (!hall_tracker_filter_edge(&filter, event.sensor, event.timestamp)) {
+                // Still publish the counters
+                state.counters = filter.counters;
+                hall_tracker_snapshot_write(&published, &state);
+                continue;
+            }
+
+            // The calibration works out the sensor angles for forward
+            // rotation, from the edges the filter took
+            if (sensor_calibration_running() && filter.estimator.velocity > 0)
+                sensor_calibration_feed(event.sensor, event.timestamp);
+        }
 
-        xSemaphoreTake(mutex, portMAX_DELAY);
+        const angle_estimator *estimator = &filter.estimator;
 
-        if (event.angle == last_angle) {
-            xSemaphoreGive(mutex);
-            continue;
+        state.timestamp = estimator->propagated_at;
+        state.phase = hall_tracker_position_to_phase(estimator->position);
+        state.angle_delta = filter.angle_delta;
+        state.frequency = (int)(estimator->velocity * 1000.0f);
+        state.acceleration = estimator->acceleration;
+        state.valid = angle_estimator_valid(estimator);
+        state.sensors = filter.sensors;
+        state.counters = filter.counters;
+
+        if (state.valid && (state.frequency < 0) != backwards) {
+            backwards = state.frequency < 0;
+            ESP_LOGI(TAG, "Wheel is turning %s", backwards ? "backwards" : "forwards");
         }
 
-        int angle_delta = (event.angle - last_angle + 360) % 360;
+        hall_tracker_snapshot_write(&published, &state);
+    }
+}
 
-        if (angle_delta > 180)
-            angle_delta -= 180;
+#if CONFIG_SPOKESPICE_SIMULATE_ROTATION
+// This task feeds the hall tracker with a simulated rotation of the
+// arms. This is useful for testing the LED strips without having to
+// rotate the wheel the arms are mounted on. The profile spins up, rides
+// with some wobble, slows down and stops, with sensors that jitter, miss
+// the odd magnet and bounce.
+static const rotation_sim_segment simulation_profile[] = {
+    { 5000, 8.0f },   // spin up
+    { 20000, 8.0f },
+    { 5000, 2.0f },   // brake
+    { 10000, 2.0f },
+    { 2000, 0.0f },   // stop
+    { 5000, 0.0f },
+};
 
-        int64_t time_delta_ms = (event.timestamp - last_timestamp) / 1000;
+static void simulate_rotation_task_func(void *)
+{
+    rotation_sim_config config = {
+        .segments = simulation_profile,
+        .num_segments = sizeof(simulation_profile) / sizeof(simulation_profile[0]),
+        .loop = true,
+        .num_sensors = MAX_ARMS,
+        .jitter_us = 20,
+        .dropout = 0.01f,
+        .bounce = 0.01f,
+        .bounce_us = 300,
+        .wobble = 0.05f,
+        .seed = esp_timer_get_time(),
+    };
 
-        if (last_timestamp > 0 && time_delta_ms > 0) {
-            f = (angle_delta * 1000000) / (360 * time_delta_ms);
+    for (int i = 0; i < MAX_ARMS; i++)
+        config.sensor_positions[i] = hall_tracker_phase_to_position(phase_from_degrees(global_app_config->arm[i].angle));
 
-            freq_moving_avg[freq_moving_avg_index++] = f;
-            freq_moving_avg_index %= FREQ_MOVING_AVG_SIZE;
+    rotation_sim sim;
+    rotation_sim_init(&sim, &config);
 
-            int sum = 0;
+    int64_t start = esp_timer_get_time();
+    int sensor;
+    int64_t timestamp;
 
-            for (int i = 0; i < FREQ_MOVING_AVG_SIZE; i++)
-                sum += freq_moving_avg[i];
+    ESP_LOGI(TAG, "Simulating rotation");
 
-            frequency = sum / FREQ_MOVING_AVG_SIZE;
-        }
+    while (rotation_sim_next_edge(&sim, &sensor, &timestamp)) {
+        int64_t edge = start + timestamp;
 
-        last_angle = event.angle;
-        last_timestamp = event.timestamp;
-        last_angle_delta = angle_delta;
+        // Only hand the edge over once its time has come, like a real one
+        int64_t delay = edge - esp_timer_get_time();
+        if (delay > 0)
+            vTaskDelay(pdMS_TO_TICKS(delay / 1000) + 1);
 
-        xSemaphoreGive(mutex);
+        hall_tracker_feed(sensor, edge);
     }
+
+    ESP_LOGI(TAG, "Rotation simulation ended");
+    vTaskDelete(NULL);
 }
+#endif
 
-// This function calls into the hall tracker to simulate a rotation
-// of the arms. This is useful for testing the LED strips without
-// having to rotate the wheel the arms are mounted on.
-static void IRAM_ATTR simulate_rotation_task_func(void *)
-{
-    while (true) {
-        for (int i = 0; i < MAX_ARMS; i++) {
-            arm_config *config = &global_app_config->arm[i];
+static bool hall_tracker_locked(const hall_tracker_snapshot *state, int64_t now) {
+    int speed = abs(state->frequency);
 
-            portDISABLE_INTERRUPTS();
-            hall_tracker_trigger(config->angle);
-            portENABLE_INTERRUPTS();
+    if (!state->valid || speed <= min_frequency)
+        return false;
 
-            vTaskDelay(75 / portTICK_PERIOD_MS);
-        }
-    }
+    // A missed edge or two doesn't lose the lock, even at low speed
+    int64_t elapsed = now - state->timestamp;
+    int64_t edge_interval = 1000000000LL / ((int64_t)speed * (state->sensors > 0 ? state->sensors : 1));
+
+    return elapsed / 1000 < max_time_delta || elapsed * LOCK_EDGE_INTERVALS_DEN < edge_interval * LOCK_EDGE_INTERVALS_NUM;
+}
+
+// Fills `out` from the published estimate. Returns false if the wheel
+// position is unknown at the given time.
+static bool hall_tracker_get_state_at(hall_tracker_state *out, int64_t time_us) {
+    hall_tracker_snapshot state;
+
+    hall_tracker_snapshot_read(&published, &state);
+
+    out->timestamp = state.timestamp;
+    out->phase = state.phase;
+    out->frequency = state.frequency;
+    out->acceleration = state.acceleration;
+
+    return hall_tracker_locked(&state, time_us);
 }
 
 // Returns the estimated current angle in degrees, or -1 for unknown.
 int hall_tracker_current_angle() {
-    int angle;
+    int32_t phase = hall_tracker_current_phase();
 
-    xSemaphoreTake(mutex, portMAX_DELAY);
+    return phase < 0 ? -1 : phase_to_degrees(phase);
+}
 
-    int64_t now = esp_timer_get_time();
-    int64_t time_delta_ms = (now - last_timestamp) / 1000;
+// Returns the estimated current phase, or -1 for unknown.
+int32_t hall_tracker_current_phase() {
+    return hall_tracker_phase_at(esp_timer_get_time());
+}
 
-    if (time_delta_ms < max_time_delta && frequency > min_frequency) {
-        int angle_delta = (360 * frequency * time_delta_ms) / 1000000;
-        angle = (last_angle - angle_delta + 360) % 360;
-    } else
-        angle = -1;
+// Returns the phase the wheel is estimated to have at the given time
+// (esp_timer base, in microseconds), or -1 for unknown. The time may lie
+// slightly in the future.
+int32_t hall_tracker_phase_at(int64_t time_us) {
+    hall_tracker_state state;
 
-    // ESP_LOGI(TAG, "angle: %d, time_delta_ms: %lld, frequency: %d", angle, time_delta_ms, frequency);
+    if (!hall_tracker_get_state_at(&state, time_us))
+        return -1;
 
-    xSemaphoreGive(mutex);
+    return hall_tracker_state_phase_at(&state, time_us);
+}
 
-    return angle;
+bool hall_tracker_get_state(hall_tracker_state *out) {
+    return hall_tracker_get_state_at(out, esp_timer_get_time());
+}
+
+phase_t hall_tracker_state_phase_at(const hall_tracker_state *state, int64_t time_us) {
+    int64_t time_delta_us = time_us - state->timestamp;
+    int64_t phase_delta = ((int64_t)state->frequency * time_delta_us * PHASE_FULL) / 1000000000LL;
+    float dt = time_delta_us * 1e-6f;
+
+    phase_delta += (int32_t)(0.5f * state->acceleration * dt * dt * PHASE_FULL);
+
+    return (phase_t)(state->phase - phase_delta);
+}
+
+int hall_tracker_state_frequency_at(const hall_tracker_state *state, int64_t time_us) {
+    float dt = (time_us - state->timestamp) * 1e-6f;
+
+    return state->frequency + (int)(state->acceleration * dt * 1000.0f);
 }
 
 int hall_tracker_last_angle_delta() {
-    int angle_delta;
+    hall_tracker_snapshot state;
 
-    xSemaphoreTake(mutex, portMAX_DELAY);
-    angle_delta = last_angle_delta;
-    xSemaphoreGive(mutex);
+    hall_tracker_snapshot_read(&published, &state);
 
-    return angle_delta;
+    return state.angle_delta;
+}
+
+void hall_tracker_get_counters(hall_tracker_counters *counters)
+{
+    hall_tracker_snapshot state;
+
+    hall_tracker_snapshot_read(&published, &state);
+
+    *counters = state.counters;
 }
 
 int hall_tracker_current_frequency()
 {
-    int f;
+    hall_tracker_snapshot state;
 
-    xSemaphoreTake(mutex, portMAX_DELAY);
-    f = frequency;
-    xSemaphoreGive(mutex);
+    hall_tracker_snapshot_read(&published, &state);
 
-    return f;
+    return state.frequency;
 }
 
 void hall_tracker_init() {
-    last_angle = 0.;
-    last_timestamp = 0;
+    hall_tracker_snapshot initial = {};
+
+    atomic_init(&published.sequence, 0);
+    hall_tracker_snapshot_write(&published, &initial);
+
+    // Room for a few milliseconds of gyro samples on top of the edges
+    queue = xQueueCreate(32, sizeof(struct hall_tracker_trigger_event));
 
-    mutex = xSemaphoreCreateMutex();
-    queue = xQueueCreate(10, sizeof(struct hall_tracker_trigger_event));
+    xTaskCreate(hall_tracker_task_func, "HAL tracker task", 3072, NULL, 10, NULL);
 
-    xTaskCreate(hall_tracker_task_func, "HAL tracker task", 2048, NULL, 10, NULL);
-    //xTaskCreate(simulate_rotation_task_func, "Rotation simulator", 2048, NULL, 1, NULL);
+#if CONFIG_SPOKESPICE_SIMULATE_ROTATION
+    xTaskCreate(simulate_rotation_task_func, "Rotation simulator", 3072, NULL, 1, NULL);
+#endif
 }
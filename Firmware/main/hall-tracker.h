@@ -1,7 +1,85 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "angle-estimator.h"
+#include "gyro-fusion.h"
+#include "utils.h"
+
+typedef struct {
+    int64_t timestamp; // of the estimate, in microseconds
+    phase_t phase;     // at that time
+    int frequency;     // in millihertz, negative when turning backwards
+    float acceleration; // in revolutions per second squared, same sign convention
+} hall_tracker_state;
+
+// Edges the tracker didn't take at face value, since startup
+typedef struct {
+    uint32_t bounces;   // a sensor firing again right away
+    uint32_t outliers;  // edges that didn't fit the estimate
+    uint32_t inferred;  // edges that went missing
+    uint32_t resyncs;   // restarts of the estimate after repeated outliers
+} hall_tracker_counters;
+
 void hall_tracker_init();
-void hall_tracker_trigger(int angle);
+
+// Feeds an edge of the given arm's hall sensor. Must be called from an ISR.
+void hall_tracker_trigger(int sensor);
+
+// Feeds an edge that was timestamped elsewhere, e.g. by a capture unit.
+// Must be called from an ISR.
+void hall_tracker_trigger_at(int sensor, int64_t timestamp);
+
+// Same as hall_tracker_trigger_at(), from a task
+void hall_tracker_feed(int sensor, int64_t timestamp);
+
+// Feeds an angular rate sample from the IMU, in revolutions per second in
+// the direction the phase runs down. Called from a task.
+void hall_tracker_gyro_sample(int64_t timestamp, float rate);
 int hall_tracker_current_angle();
+int32_t hall_tracker_current_phase();
+int32_t hall_tracker_phase_at(int64_t time_us);
+// Signed rotation frequency in millihertz. The direction comes from the
+// order in which the sensors fire. Forwards, the phase runs down.
 int hall_tracker_current_frequency();
 int hall_tracker_last_angle_delta();
+
+// Fills `state` with the tracker's latest estimate. Returns false if the
+// wheel position is currently unknown.
+bool hall_tracker_get_state(hall_tracker_state *state);
+
+// Extrapolates an estimate to the given time, including the acceleration.
+// Everything that looks ahead goes through these, so the scheduler wakes
+// up at the column boundaries the renderer computes.
+phase_t hall_tracker_state_phase_at(const hall_tracker_state *state, int64_t time_us);
+int hall_tracker_state_frequency_at(const hall_tracker_state *state, int64_t time_us);
+
+void hall_tracker_get_counters(hall_tracker_counters *counters);
+
+// The per-edge processing of the tracker task, on its own in
+// hall-tracker-filter.c so recorded edges can be replayed through exactly
+// the same code, on the device or in the host build (see host/).
+typedef struct {
+    angle_estimator estimator;
+    gyro_fusion fusion;
+    int last_sensor;
+    int last_angle;
+    int angle_delta;  // between the last two edges, in degrees
+    int64_t last_timestamp;
+    int consecutive_rejects;
+    int sensors;      // number of sensors fitted
+    hall_tracker_counters counters;
+} hall_tracker_filter;
+
+void hall_tracker_filter_init(hall_tracker_filter *filter);
+
+// Returns false if the edge was dropped
+bool hall_tracker_filter_edge(hall_tracker_filter *filter, int sensor, int64_t timestamp);
+
+// Phase of a sensor, including its calibrated offset
+phase_t hall_tracker_sensor_phase(int sensor);
+
+// Converts a phase to the estimator's position, which counts up in the
+// direction of rotation
+float hall_tracker_phase_to_position(phase_t phase);
@@ -1,71 +1,65 @@
-#include <math.h>
-
 #pragma once
 
-#define max(a, b) ((a) > (b) ? (a) : (b))
-#define min(a, b) ((a) > (b) ? (b) : (a))
-
-static void HSVtoRGB(float h, float s, float v, int *r, int *g, int *b)
+// Integer HSV to RGB conversion. `h` is in degrees (0-360), `s` and `v` are
+// percentages (0-100), the outputs are 0-255.
+static void HSVtoRGB(int h, int s, int v, int *r, int *g, int *b)
 {
-    int i;
-    float f, p, q, t;
-
-    h = max(0.0f, min(360.0f, h));
-    s = max(0.0f, min(100.0f, s));
-    v = max(0.0f, min(100.0f, v));
+    h = h < 0 ? 0 : (h > 360 ? 360 : h);
+    s = s < 0 ? 0 : (s > 100 ? 100 : s);
+    v = v < 0 ? 0 : (v > 100 ? 100 : v);
 
-    s /= 100;
-    v /= 100;
+    // Scale to 0-255, rounded
+    int value = (v * 255 + 50) / 100;
+    int saturation = (s * 255 + 50) / 100;
 
-    if (s == 0)
+    if (saturation == 0)
     {
         // Achromatic (grey)
-        *r = *g = *b = round(v * 255);
+        *r = *g = *b = value;
         return;
     }
 
-    h /= 60; // sector 0 to 5
-    i = floor(h);
-    f = h - i; // factorial part of h
-    p = v * (1 - s);
-    q = v * (1 - s * f);
-    t = v * (1 - s * (1 - f));
+    int i = h / 60;                // sector 0 to 5
+    int f = (h % 60) * 256 / 60;   // position within the sector, 0-255
+    int p = value * (255 - saturation) / 255;
+    int q = value * (255 - saturation * f / 256) / 255;
+    int t = value * (255 - saturation * (256 - f) / 256) / 255;
 
     switch (i)
     {
     case 0:
-        *r = round(255 * v);
-        *g = round(255 * t);
-        *b = round(255 * p);
+        *r = value;
+        *g = t;
+        *b = p;
         break;
 
     case 1:
-        *r = round(255 * q);
-        *g = round(255 * v);
-        *b = round(255 * p);
+        *r = q;
+        *g = value;
+        *b = p;
         break;
     case 2:
-        *r = round(255 * p);
-        *g = round(255 * v);
-        *b = round(255 * t);
+        *r = p;
+        *g = value;
+        *b = t;
         break;
 
     case 3:
-        *r = round(255 * p);
-        *g = round(255 * q);
-        *b = round(255 * v);
+        *r = p;
+        *g = q;
+        *b = value;
         break;
 
     case 4:
-        *r = round(255 * t);
-        *g = round(255 * p);
-        *b = round(255 * v);
+        *r = t;
+        *g = p;
+        *b = value;
         break;
 
     default: // case 5:
-        *r = round(255 * v);
-        *g = round(255 * p);
-        *b = round(255 * q);
+        *r = value;
+        *g = p;
+        *b = q;
         break;
     }
-}
\ No newline at end of file
+}
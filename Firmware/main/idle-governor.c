@@ -0,0 +1,126 @@
+#include "freertos/FreeRTOS.h"
+#include "driver/gpio.h"
+#include "esp_sleep.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+#include "app-config.h"
+#include "hall-tracker.h"
+#include "hardware.h"
+#include "idle-governor.h"
+
+static const char *TAG = "idle";
+
+static uint32_t sleep_levels;  // of the hall sensors when going to sleep, bit per arm
+static uint32_t sleeps;
+
+// Whether the hall sensor pins have an edge interrupt of their own
+#define HALL_GPIO_ISR (!CONFIG_SPOKESPICE_HALL_CAPTURE || CONFIG_SPOKESPICE_HALL_CAPTURE_COMPARE)
+
+static int64_t last_active;
+static int64_t wake_time;  // 0 once the first column after waking is out
+
+void idle_governor_init()
+{
+    last_active = esp_timer_get_time();
+    wake_time = 0;
+}
+
+// Clearing waits for the transfer, so the strips are dark before we sleep
+static void idle_governor_blank()
+{
+    for (int i = 0; i < MAX_ARMS; i++) {
+        if (led_strip[i] == NULL)
+            continue;
+
+        led_strip_clear(led_strip[i]);
+    }
+}
+
+static void idle_governor_sleep()
+{
+    sleep_levels = 0;
+
+    // Wake-up on GPIO is level triggered. A sensor that sits in front of a
+    // magnet is already low, so it wakes us up once it goes high again.
+    for (int i = 0; i < MAX_ARMS; i++) {
+        int pin = global_app_config->arm[i].hall_sensor_pin;
+
+        if (pin < 0)
+            continue;
+
+        int level = gpio_get_level(pin);
+
+        sleep_levels |= level << i;
+
+#if HALL_GPIO_ISR
+        // The wake-up turns the edge interrupt into a level one, which
+        // would keep firing while the pin holds its level after waking
+        gpio_intr_disable(pin);
+#endif
+
+        ESP_ERROR_CHECK(gpio_wakeup_enable(pin, level ? GPIO_INTR_LOW_LEVEL : GPIO_INTR_HIGH_LEVEL));
+    }
+
+    ESP_ERROR_CHECK(esp_sleep_enable_gpio_wakeup());
+
+    ESP_LOGI(TAG, "Idle for %d s, going to sleep", global_app_config->idle_timeout_seconds);
+
+    esp_light_sleep_start();
+
+    wake_time = esp_timer_get_time();
+    sleeps++;
+
+    // The sensor whose level went low is the edge that woke us up. It
+    // never made it to the interrupt handler, so hand it over here.
+    int woken_by = -1;
+
+    for (int i = 0; i < MAX_ARMS; i++) {
+        int pin = global_app_config->arm[i].hall_sensor_pin;
+
+        if (pin < 0)
+            continue;
+
+        gpio_wakeup_disable(pin);
+
+        if ((sleep_levels & (1 << i)) && gpio_get_level(pin) == 0)
+            woken_by = i;
+
+#if HALL_GPIO_ISR
+        gpio_set_intr_type(pin, GPIO_INTR_NEGEDGE);
+        gpio_intr_enable(pin);
+#endif
+    }
+
+    if (woken_by >= 0)
+        hall_tracker_feed(woken_by, wake_time);
+
+    ESP_LOGI(TAG, "Woken up by sensor %d after sleep %lu", woken_by, sleeps);
+}
+
+void idle_governor_update(int64_t now, bool locked)
+{
+    int timeout = global_app_config->idle_timeout_seconds;
+
+    if (locked || timeout <= 0) {
+        last_active = now;
+        return;
+    }
+
+    if (now - last_active < (int64_t)timeout * 1000000)
+        return;
+
+    idle_governor_blank();
+    idle_governor_sleep();
+
+    last_active = esp_timer_get_time();
+}
+
+void idle_governor_column_rendered(int64_t now)
+{
+    if (wake_time == 0)
+        return;
+
+    ESP_LOGI(TAG, "First column %lld us after waking up", now - wake_time);
+    wake_time = 0;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Saves the battery while the wheel stands still. After
+// app_config.idle_timeout_seconds without a lock on the wheel, the strips
+// are blanked and the chip goes to light sleep, until one of the hall
+// sensors changes level. The sensor that woke us up is fed to the tracker
+// as an edge, so the display locks again on the next one.
+//
+// Light sleep keeps the RAM, so the tracker still knows which way the
+// wheel turned last. The time from waking up to the first rendered column
+// is logged.
+
+void idle_governor_init();
+
+// Called by the render loop on every iteration. Sleeps if it's time to.
+void idle_governor_update(int64_t now, bool locked);
+
+// Called by the render loop when it has put out a column
+void idle_governor_column_rendered(int64_t now);
@@ -0,0 +1,145 @@
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/i2c_master.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "esp_check.h"
+
+#include "hall-tracker.h"
+#include "imu.h"
+#include "pins.h"
+
+static const char *TAG = "imu";
+
+#define I2C_FREQUENCY_HZ 400000
+#define I2C_TIMEOUT_MS 10
+
+#define REG_WHO_AM_I 0x0f
+#define REG_CTRL2_G 0x11
+#define REG_CTRL3_C 0x12
+#define REG_OUTX_L_G 0x22
+
+#define WHO_AM_I_LSM6DSR 0x6b
+
+// 833 Hz output data rate, ±4000 dps full scale
+#define CTRL2_G_833HZ_4000DPS 0x71
+// Block data update, register address auto-increment
+#define CTRL3_C_BDU_IF_INC 0x44
+
+#define DPS_PER_LSB 0.140f
+
+// Close to full scale the sample may have clipped
+#define SATURATION_LIMIT 32000
+
+#define SAMPLE_INTERVAL_US 2000
+
+// The output registers hold the average over the last sample period, which
+// lags the time they are read by about half an output data period plus
+// the digital filter delay
+#define SAMPLE_LATENCY_US 600
+
+#define REPORT_INTERVAL_US 10000000
+
+static i2c_master_bus_handle_t bus;
+static i2c_master_dev_handle_t device;
+static TaskHandle_t task;
+
+static esp_err_t imu_write_register(uint8_t reg, uint8_t value) {
+    uint8_t buffer[2] = { reg, value };
+
+    return i2c_master_transmit(device, buffer, sizeof(buffer), I2C_TIMEOUT_MS);
+}
+
+static esp_err_t imu_read_registers(uint8_t reg, uint8_t *data, size_t length) {
+    return i2c_master_transmit_receive(device, &reg, 1, data, length, I2C_TIMEOUT_MS);
+}
+
+static void imu_timer_callback(void *arg) {
+    xTaskNotifyGive(task);
+}
+
+static void imu_task_func(void *args) {
+    uint32_t samples = 0;
+    uint32_t errors = 0;
+    uint32_t saturated = 0;
+    int64_t last_report = esp_timer_get_time();
+
+    while (true) {
+        uint8_t data[6];
+
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        if (imu_read_registers(REG_OUTX_L_G, data, sizeof(data)) != ESP_OK) {
+            errors++;
+            continue;
+        }
+
+        int64_t timestamp = esp_timer_get_time() - SAMPLE_LATENCY_US;
+        int axis = CONFIG_SPOKESPICE_IMU_AXIS;
+        int16_t raw = (int16_t)(data[2 * axis] | (data[2 * axis + 1] << 8));
+
+        if (abs(raw) > SATURATION_LIMIT) {
+            saturated++;
+        } else {
+            float rate = raw * DPS_PER_LSB / 360.0f;
+
+#if CONFIG_SPOKESPICE_IMU_INVERT
+            rate = -rate;
+#endif
+            hall_tracker_gyro_sample(timestamp, rate);
+            samples++;
+        }
+
+        if (timestamp - last_report > REPORT_INTERVAL_US) {
+            ESP_LOGI(TAG, "%lu samples, %lu saturated, %lu read errors",
+                     samples, saturated, errors);
+            last_report = timestamp;
+        }
+    }
+}
+
+esp_err_t imu_init() {
+    i2c_master_bus_config_t bus_config = {
+        .i2c_port = -1,
+        .sda_io_num = PIN_I2C_SDA,
+        .scl_io_num = PIN_I2C_SCL,
+        .clk_source = I2C_CLK_SRC_DEFAULT,
+        .glitch_ignore_cnt = 7,
+        .flags.enable_internal_pullup = true,
+    };
+    i2c_device_config_t device_config = {
+        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
+        .device_address = CONFIG_SPOKESPICE_IMU_ADDRESS,
+        .scl_speed_hz = I2C_FREQUENCY_HZ,
+    };
+    uint8_t who_am_i;
+
+    ESP_RETURN_ON_ERROR(i2c_new_master_bus(&bus_config, &bus), TAG, "Failed to create I2C bus");
+    ESP_RETURN_ON_ERROR(i2c_master_bus_add_device(bus, &device_config, &device), TAG, "Failed to add IMU");
+
+    ESP_RETURN_ON_ERROR(imu_read_registers(REG_WHO_AM_I, &who_am_i, 1), TAG, "No IMU at 0x%02x", CONFIG_SPOKESPICE_IMU_ADDRESS);
+    if (who_am_i != WHO_AM_I_LSM6DSR) {
+        ESP_LOGE(TAG, "Unexpected IMU id 0x%02x", who_am_i);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    ESP_RETURN_ON_ERROR(imu_write_register(REG_CTRL3_C, CTRL3_C_BDU_IF_INC), TAG, "Failed to configure IMU");
+    ESP_RETURN_ON_ERROR(imu_write_register(REG_CTRL2_G, CTRL2_G_833HZ_4000DPS), TAG, "Failed to configure gyro");
+
+    // Above the tracker, so the samples are fresh when they are queued
+    xTaskCreate(imu_task_func, "IMU", 3072, NULL, 11, &task);
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = imu_timer_callback,
+        .name = "imu",
+    };
+    esp_timer_handle_t timer;
+
+    ESP_RETURN_ON_ERROR(esp_timer_create(&timer_args, &timer), TAG, "Failed to create timer");
+    ESP_RETURN_ON_ERROR(esp_timer_start_periodic(timer, SAMPLE_INTERVAL_US), TAG, "Failed to start timer");
+
+    ESP_LOGI(TAG, "Gyro running, axis %d", CONFIG_SPOKESPICE_IMU_AXIS);
+
+    return ESP_OK;
+}
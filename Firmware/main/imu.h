@@ -0,0 +1,13 @@
+#pragma once
+
+#include "esp_err.h"
+
+// Angular rate of the wheel from the gyroscope of the IMU on the I2C bus.
+// The rate about the wheel axle is sampled at a fixed rate and fed to the
+// hall tracker, which integrates it between magnet passes.
+//
+// The driver targets an LSM6DSR, whose ±4000 dps range covers a wheel
+// turning at up to 11 revolutions per second. The axis that lines up with
+// the axle and its sign are set in the configuration.
+
+esp_err_t imu_init();
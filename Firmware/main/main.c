@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "driver/gpio.h"
@@ -12,11 +13,20 @@
 
 #include "app-config.h"
 #include "canvas.h"
+#include "color-lut.h"
+#include "column-scheduler.h"
+#include "edge-recorder.h"
 #include "pattern.h"
 #include "gif.h"
 #include "playlist.h"
+#include "hall-capture.h"
 #include "hall-tracker.h"
+#include "idle-governor.h"
+#include "imu.h"
 #include "pins.h"
+#include "power-limiter.h"
+#include "render-latency.h"
+#include "sensor-calibration.h"
 #include "utils.h"
 #include "wifi.h"
 #include "esp_spiffs.h"
@@ -39,25 +49,38 @@ enum {
     MODE_GIF,
 };
 
-static int mode = 0;
+static volatile int mode = 0;
+
+// The render task and the GIF decoder share this core. The render task
+// sleeps between columns and the decoder runs in the gaps.
+#define RENDER_CORE 1
+
+// Wake up slightly after the predicted column boundary, so the tracker's
+// angle estimate has already moved on to the new column.
+#define COLUMN_WAKE_MARGIN_US 2
+
+// Render steps per column when interpolating between columns
+#define INTERPOLATION_STEPS 4
 
 static void led(int i, bool on)
 {
     gpio_set_level(i == 0 ? PIN_LED_1 : PIN_LED_2, on ? 1 : 0);
 }
 
+#if !CONFIG_SPOKESPICE_HALL_CAPTURE
 static void IRAM_ATTR hall_interrupt_handler(void *args)
 {
-    arm_config *arm = (arm_config *)args;
-
-    hall_tracker_trigger(arm->angle);
+    hall_tracker_trigger((intptr_t)args);
 }
+#endif
 
 static void update_strips_task_func(void *)
 {
     uint32_t counter = 0;
     uint64_t last_change = 0;
-    int last_angle = -1;
+    int32_t last_phase = -1;
+    phase_t last_render_phase = 0;
+    int last_column = -1;
 
     ESP_LOGI(TAG, "Starting stripe update task");
 
@@ -65,11 +88,11 @@ static void update_strips_task_func(void *)
     led(1, (counter++ & 0x80) == 0); 
 
     while (true) {
-        int angle = hall_tracker_current_angle();
+        int32_t phase = hall_tracker_current_phase();
         uint64_t now = esp_timer_get_time();
 
-        if (angle >= 0) {
-            if (last_angle < 0) {
+        if (phase >= 0) {
+            if (last_phase < 0) {
                 mode = MODE_GIF;
                 playlist_next();
             }
@@ -77,10 +100,12 @@ static void update_strips_task_func(void *)
             mode = MODE_PATTERN;
         }
 
-        last_angle = angle;
+        last_phase = phase;
+
+        idle_governor_update(now, phase >= 0);
 
         if (now - last_change > 1000000 * global_app_config->pattern_change_interval_seconds) {
-            if (mode == MODE_PATTERN && angle > 0) {
+            if (mode == MODE_PATTERN && phase >= 0) {
                 mode = MODE_GIF;
                 playlist_next();
             } else {
@@ -94,23 +119,84 @@ static void update_strips_task_func(void *)
         switch (mode) {
         case MODE_PATTERN:
             pattern_tick();
+            column_scheduler_sleep_until(now + PATTERN_TICK_INTERVAL_US);
             break;
 
-        case MODE_GIF:
-            gif_tick();
+        case MODE_GIF: {
+            phase_t offset = phase_from_degrees(global_app_config->angle_offset);
+            phase_t render_phase = phase + offset;
+            int steps = global_app_config->interpolate_columns ? INTERPOLATION_STEPS : 1;
+            int column = phase_to_column(render_phase, CANVAS_WIDTH * steps);
+
+            // Only pick up a new frame when a revolution starts, so the
+            // image never changes halfway around the wheel.
+            bool swapped = abs((int)render_phase - (int)last_render_phase) > PHASE_FULL / 2 && canvas_swap();
+
+            last_render_phase = render_phase;
 
-            angle = angle_normalize(angle + global_app_config->angle_offset);
+            if (column != last_column || swapped) {
+                phase_t arm_phases[MAX_ARMS];
+                int column_ma = 0;
 
-            for (int i = 0; i < MAX_ARMS; i++) {
-                led_strip_handle_t strip = led_strip[i];
-                arm_config *config = &global_app_config->arm[i];
+                // Render the column for where each arm will be when the
+                // LEDs latch it, not for where it is right now.
+                for (int i = 0; i < MAX_ARMS; i++) {
+                    if (led_strip[i] == NULL)
+                        continue;
 
-                if (strip != NULL)
-                    canvas_render(strip, config, angle);
+                    int32_t arm_phase = hall_tracker_phase_at(esp_timer_get_time() + render_latency_us(i));
+
+                    arm_phases[i] = arm_phase < 0 ? render_phase : (phase_t)(arm_phase + offset);
+                    column_ma += canvas_estimate_ma(&global_app_config->arm[i], color_lut_for_arm(i), arm_phases[i]);
+                }
+
+                power_limiter_update(column_ma);
+
+                for (int i = 0; i < MAX_ARMS; i++) {
+                    led_strip_handle_t strip = led_strip[i];
+
+                    if (strip == NULL)
+                        continue;
+
+                    render_latency_start(i, esp_timer_get_time());
+                    canvas_render(strip, &global_app_config->arm[i], color_lut_for_arm(i),
+                                  arm_phases[i], power_limiter_scale());
+                }
+
+                // The strips are double-buffered, so this only queues the
+                // transfers and we can go on with the next column while the
+                // current one is still going out on the wire.
+                for (int i = 0; i < MAX_ARMS; i++) {
+                    if (led_strip[i] != NULL && led_strip_refresh_async(led_strip[i]) != ESP_OK)
+                        render_latency_cancel(i);
+                }
+
+                idle_governor_column_rendered(esp_timer_get_time());
+                last_column = column;
             }
 
+            render_latency_report(now);
+            power_limiter_report(now);
+
+            // Sleep until the wheel has turned by one column. The decoder
+            // task on this core gets the time in between.
+            int64_t next = column_scheduler_next_column_time(esp_timer_get_time(), steps);
+            column_scheduler_sleep_until(next >= 0 ? next + COLUMN_WAKE_MARGIN_US : now + PATTERN_TICK_INTERVAL_US);
             break;
         }
+        }
+    }
+}
+
+static void gif_decoder_task_func(void *)
+{
+    ESP_LOGI(TAG, "Starting GIF decoder task");
+
+    while (true) {
+        if (mode == MODE_GIF)
+            gif_tick();
+
+        vTaskDelay(1);
     }
 }
 
@@ -206,6 +292,8 @@ void app_main(void)
     ESP_ERROR_CHECK(ret);
 
     load_app_config();
+    color_lut_init();
+    sensor_calibration_init();
     hall_tracker_init();
     canvas_init();
     gif_init();
@@ -216,12 +304,19 @@ void app_main(void)
         playlist_init(sdcard_dir);
     }
 
+    edge_recorder_init(ret == ESP_OK ? sdcard_dir : NULL);
+
     ret = spiffs_init();
     if (ret == ESP_OK) {
         ESP_LOGI(TAG, "SPIFFS initialized");
         playlist_init(spiffs_dir);
     }
 
+    if (playlist_init_partition("animations") == ESP_OK)
+        ESP_LOGI(TAG, "Playing animations from flash");
+
+    playlist_start();
+
     gpio_install_isr_service(0);
 
     for (int i = 0; i < MAX_ARMS; i++) {
@@ -230,8 +325,10 @@ void app_main(void)
         if (arm->hall_sensor_pin >= 0) {
             ESP_ERROR_CHECK(gpio_set_direction(arm->hall_sensor_pin, GPIO_MODE_INPUT));
             ESP_ERROR_CHECK(gpio_set_pull_mode(arm->hall_sensor_pin, GPIO_PULLUP_ONLY));
+#if !CONFIG_SPOKESPICE_HALL_CAPTURE
             ESP_ERROR_CHECK(gpio_set_intr_type(arm->hall_sensor_pin, GPIO_INTR_NEGEDGE));
-            ESP_ERROR_CHECK(gpio_isr_handler_add(arm->hall_sensor_pin, hall_interrupt_handler, arm));
+            ESP_ERROR_CHECK(gpio_isr_handler_add(arm->hall_sensor_pin, hall_interrupt_handler, (void *)(intptr_t)i));
+#endif
         }
 
         if (arm->led_pin >= 0 && arm->num_leds > 0) {
@@ -241,6 +338,7 @@ void app_main(void)
             };
             led_strip_rmt_config_t rmt_config = {
                 .resolution_hz = 20 * 1000 * 1000, // 10MHz
+                .flags.double_buffer = true,
             };
 
             ESP_ERROR_CHECK(led_strip_new_rmt_device(&strip_config, &rmt_config, &led_strip[i]));
@@ -251,6 +349,18 @@ void app_main(void)
                  i, arm->hall_sensor_pin, arm->led_pin, arm->angle);
     }
 
+#if CONFIG_SPOKESPICE_HALL_CAPTURE
+    ESP_ERROR_CHECK(hall_capture_init());
+#endif
+
+#if CONFIG_SPOKESPICE_IMU
+    // The hall sensors do the job on their own as well
+    if (imu_init() != ESP_OK)
+        ESP_LOGW(TAG, "Running without gyro");
+#endif
+
+    render_latency_init();
+
     ESP_ERROR_CHECK(gpio_set_direction(PIN_LED_1, GPIO_MODE_OUTPUT));
     ESP_ERROR_CHECK(gpio_set_direction(PIN_LED_2, GPIO_MODE_OUTPUT));
 
@@ -259,5 +369,9 @@ void app_main(void)
 
     // esp_intr_dump(stdout);
 
-    xTaskCreate(update_strips_task_func, "Stripes", 4096, NULL, 1, NULL);
+    column_scheduler_init();
+    idle_governor_init();
+
+    xTaskCreatePinnedToCore(update_strips_task_func, "Stripes", 4096, NULL, 5, NULL, RENDER_CORE);
+    xTaskCreatePinnedToCore(gif_decoder_task_func, "GIF decoder", 4096, NULL, 1, NULL, RENDER_CORE);
 }
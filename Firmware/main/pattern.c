@@ -4,7 +4,9 @@
 #include "driver/gpio.h"
 
 #include "app-config.h"
+#include "color-lut.h"
 #include "pattern.h"
+#include "power-limiter.h"
 #include "hardware.h"
 #include "hsv2rgb.h"
 #include "utils.h"
@@ -13,35 +15,56 @@ static const char *TAG = "patterns";
 
 typedef void (*pattern_tick_func)(led_strip_handle_t strip, const arm_config *config, uint32_t counter);
 
+// Colour correction of the arm that is currently being ticked
+static const color_lut *current_lut;
+
+// Patterns are drawn pixel by pixel, so the draw of a tick is only known
+// once it is done. The limiter scale from the previous tick is applied.
+static int current_scale = POWER_LIMITER_FULL_SCALE;
+static uint32_t tick_load;
+
+static void set_pixel(led_strip_handle_t strip, int index, int r, int g, int b) {
+    uint8_t pixel[3] = { g, r, b };
+
+    color_lut_apply(current_lut, pixel, pixel, 1);
+    tick_load += pixel[0] + pixel[1] + pixel[2];
+
+    if (current_scale < POWER_LIMITER_FULL_SCALE)
+        for (int c = 0; c < 3; c++)
+            pixel[c] = (pixel[c] * current_scale) >> 8;
+
+    led_strip_set_pixels(strip, index, 1, pixel);
+}
+
 static void rainbow_tick(led_strip_handle_t strip, const arm_config *config, uint32_t counter) {
     for (int i = 0; i < config->num_leds; i++) {
         int r, g, b;
-        float a = angle_normalize(config->angle/50 - counter - (i * 3));
+        int a = angle_normalize(config->angle/50 - counter - (i * 3));
 
         HSVtoRGB(a, 100, 50, &r, &g, &b);
-        led_strip_set_pixel(strip, i, r, g, b);
+        set_pixel(strip, i, r, g, b);
     }
 }
 
 static void chasing_lights_1_tick(led_strip_handle_t strip, const arm_config *config, uint32_t counter) {
-    float a = angle_normalize(config->angle + counter/3);
+    int a = angle_normalize(config->angle + counter/3);
     int peak = (counter % (config->num_leds * 3)) - config->num_leds;
 
     for (int i = 0; i < config->num_leds; i++) {
         int r, g, b;
         int d = abs(i - peak);
-        float v = 0;
+        int v = 0;
 
         if (d < 5)
             v = 50 / (d+1);
 
         HSVtoRGB(a, 100, v, &r, &g, &b);
-        led_strip_set_pixel(strip, i, r, g, b);
+        set_pixel(strip, i, r, g, b);
     }
 }
 
 static void chasing_lights_2_tick(led_strip_handle_t strip, const arm_config *config, uint32_t counter) {
-    float a = angle_normalize(config->angle + (counter/3));
+    int a = angle_normalize(config->angle + (counter/3));
     int n = (counter/5) % (config->num_leds * 2);
 
     if (n > config->num_leds)
@@ -49,25 +72,25 @@ static void chasing_lights_2_tick(led_strip_handle_t strip, const arm_config *co
 
     for (int i = 0; i < config->num_leds; i++) {
         int r, g, b;
-        float v = 0;
+        int v = 0;
 
         if (i <= n)
             v = 50;
 
         HSVtoRGB(a, 100, v, &r, &g, &b);
-        led_strip_set_pixel(strip, i, r, g, b);
+        set_pixel(strip, i, r, g, b);
     }
 }
 
 static void chasing_lights_3_tick(led_strip_handle_t strip, const arm_config *config, uint32_t counter) {
-    float a = angle_normalize(config->angle + counter/3);
+    int a = angle_normalize(config->angle + counter/3);
     int peak = counter % (4 * (config->num_leds + 50));
     bool outwards = true;
 
     for (int i = 0; i < config->num_leds; i++) {
         int r, g, b;
         int d = abs(i - peak);
-        float v = 0;
+        int v = 0;
 
         if (d < config->num_leds)
             v = (d / 10) * 10;
@@ -75,31 +98,31 @@ static void chasing_lights_3_tick(led_strip_handle_t strip, const arm_config *co
         HSVtoRGB(a, 100, v, &r, &g, &b);
 
         if (outwards)
-            led_strip_set_pixel(strip, i, r, g, b);
+            set_pixel(strip, i, r, g, b);
         else
-            led_strip_set_pixel(strip, config->num_leds - i - 1, r, g, b);
+            set_pixel(strip, config->num_leds - i - 1, r, g, b);
     }
 
     outwards = !outwards;
 }
 
 static void chasing_lights_4_tick(led_strip_handle_t strip, const arm_config *config, uint32_t counter) {
-    float a = angle_normalize(counter/3);
+    int a = angle_normalize(counter/3);
 
     for (int i = 0; i < config->num_leds; i++) {
-        float v = 0;
+        int v = 0;
         int r, g, b;
 
         if ((i + config->num_leds - counter/40 - (config->angle / 90)) % 8 == 0)
             v = 100;
 
         HSVtoRGB(a, 100, v, &r, &g, &b);
-        led_strip_set_pixel(strip, i, r, g, b);
+        set_pixel(strip, i, r, g, b);
     }
 }
 
 static void pulse_1_tick(led_strip_handle_t strip, const arm_config *config, uint32_t counter) {
-    float a = angle_normalize(config->angle + counter/3);
+    int a = angle_normalize(config->angle + counter/3);
     int v = counter % 400;
 
     if (v > 200)
@@ -111,7 +134,7 @@ static void pulse_1_tick(led_strip_handle_t strip, const arm_config *config, uin
         int r, g, b;
 
         HSVtoRGB(a, 100, v, &r, &g, &b);
-        led_strip_set_pixel(strip, i, r, g, b);
+        set_pixel(strip, i, r, g, b);
     }
 }
 
@@ -119,10 +142,10 @@ static void sensor_test_tick(led_strip_handle_t strip, const arm_config *config,
     bool on = gpio_get_level(config->hall_sensor_pin) == 0;
     
     for (int i = 0; i < config->num_leds; i++)
-        led_strip_set_pixel(strip, i, 0, 0, 0);
+        set_pixel(strip, i, 0, 0, 0);
 
     if (on)
-        led_strip_set_pixel(strip, config->angle/90, 255, 0, 0);
+        set_pixel(strip, config->angle/90, 255, 0, 0);
 }
 
 static pattern_tick_func pattern_tick_funcs[] = {
@@ -145,16 +168,22 @@ void pattern_tick() {
     if (current_tick_func == NULL)
         pattern_next();
 
+    current_scale = power_limiter_scale();
+    tick_load = 0;
+
     for (int i = 0; i < MAX_ARMS; i++) {
         led_strip_handle_t strip = led_strip[i];
         arm_config *arm_config = &global_app_config->arm[i];
 
         if (strip != NULL) {
+            current_lut = color_lut_for_arm(i);
             current_tick_func(strip, arm_config, counter);
-            led_strip_refresh(strip);
         }
     }
 
+    led_strip_refresh_multi(led_strip, MAX_ARMS);
+    power_limiter_update(power_limiter_load_to_ma(tick_load));
+
     counter++;
 }
 
@@ -1,13 +1,18 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_log.h"
+#include "esp_check.h"
+#include "esp_partition.h"
+#include "esp_timer.h"
 #include <dirent.h>
+#include <stdatomic.h>
 #include <string.h>
 
 #include "gif.h"
 #include "pins.h"
 #include "playlist.h"
 #include "hall-tracker.h"
+#include "rgif2.h"
 
 static const char *TAG = "Playlist";
 
@@ -15,6 +20,22 @@ static DIR *dir;
 static int count = 0;
 static const char *base_dir;
 
+// Animation pack mapped from a flash partition, played instead of the
+// directory if there is one
+static const uint8_t *pack = NULL;
+static size_t pack_size;
+static size_t pack_offset;
+
+// Loads are kept off the core the strips are rendered on
+#define LOADER_CORE 0
+
+static TaskHandle_t loader_task;
+
+// Loaded ahead of time, waiting for the next switch
+static _Atomic(gif_animation *) prefetched;
+// A switch was asked for before the prefetch was done
+static atomic_bool switch_pending;
+
 static int ls_dir()
 {
     struct dirent *entry;
@@ -36,29 +57,111 @@ static int ls_dir()
     return count;
 }
 
-void playlist_next()
+static gif_animation *playlist_load_from_pack()
 {
-    struct dirent *entry = readdir(dir);
+    if (pack_offset >= pack_size || rgif2_check(pack + pack_offset, pack_size - pack_offset) != ESP_OK)
+        pack_offset = 0;
+
+    size_t offset = pack_offset;
+
+    pack_offset = rgif2_pack_next(pack, offset);
+
+    ESP_LOGI(TAG, "Loading animation at 0x%x", offset);
+    gif_animation *animation = gif_open_mapped(pack + offset, pack_size - offset);
+    if (animation == NULL)
+        ESP_LOGE(TAG, "Failed to load animation at 0x%x", offset);
+
+    return animation;
+}
+
+static gif_animation *playlist_load_from_dir()
+{
+    struct dirent *entry;
     char path[PATH_MAX];
 
-    while (true) {
+    do {
+        entry = readdir(dir);
         if (entry == NULL) {
             rewinddir(dir);
             entry = readdir(dir);
         }
+    } while (entry != NULL && strstr(entry->d_name, ".rgif") == NULL);
 
-        if (strstr(entry->d_name, ".rgif") == NULL)
+    if (entry == NULL)
+        return NULL;
+
+    snprintf(path, PATH_MAX, "%s/%s", base_dir, entry->d_name);
+    ESP_LOGI(TAG, "Loading %s", path);
+
+    gif_animation *animation = gif_open_file(path);
+    if (animation == NULL)
+        ESP_LOGE(TAG, "Failed to load %s", path);
+
+    return animation;
+}
+
+// Loads the next animation that loads fine, giving up after a round
+// through the playlist
+static gif_animation *playlist_load_next()
+{
+    for (int i = 0; i < count; i++) {
+        int64_t start = esp_timer_get_time();
+        gif_animation *animation = pack != NULL ? playlist_load_from_pack() : playlist_load_from_dir();
+        uint32_t load_us = esp_timer_get_time() - start;
+
+        if (animation == NULL)
             continue;
 
-        snprintf(path, PATH_MAX, "%s/%s", base_dir, entry->d_name);
-        ESP_LOGI(TAG, "Loading %s", path);
+        ESP_LOGI(TAG, "Loaded in %lu ms", load_us / 1000);
 
-        esp_err_t ret = gif_load_file(path);
-        if (ret == ESP_OK)
-            return;
+        return animation;
+    }
 
-        ESP_LOGE(TAG, "Failed to load %s", path);
+    return NULL;
+}
+
+static void loader_task_func(void *arg)
+{
+    while (true) {
+        // Late for a switch, play it as soon as it's there
+        if (atomic_load(&switch_pending)) {
+            gif_animation *animation = atomic_exchange(&prefetched, NULL);
+
+            if (animation != NULL) {
+                atomic_store(&switch_pending, false);
+                gif_play(animation);
+                ESP_LOGI(TAG, "Switched late, the animation wasn't loaded in time");
+            }
+        }
+
+        if (atomic_load(&prefetched) == NULL && count > 0) {
+            gif_animation *animation = playlist_load_next();
+
+            if (animation != NULL) {
+                atomic_store(&prefetched, animation);
+                continue;
+            }
+        }
+
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+}
+
+// Called from the render task, so it only hands over what the loader task
+// has prepared
+void playlist_next()
+{
+    gif_animation *animation = atomic_exchange(&prefetched, NULL);
+
+    if (animation != NULL) {
+        atomic_store(&switch_pending, false);
+        gif_play(animation);
+    } else {
+        atomic_store(&switch_pending, true);
     }
+
+    if (loader_task != NULL)
+        xTaskNotifyGive(loader_task);
 }
 
 int playlist_count()
@@ -77,3 +180,44 @@ void playlist_init(const char *path)
     count = ls_dir();
     base_dir = path;
 }
+
+esp_err_t playlist_init_partition(const char *label)
+{
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, label);
+    if (partition == NULL)
+        return ESP_ERR_NOT_FOUND;
+
+    const void *data;
+    esp_partition_mmap_handle_t handle;
+
+    ESP_RETURN_ON_ERROR(esp_partition_mmap(partition, 0, partition->size, ESP_PARTITION_MMAP_DATA, &data, &handle),
+                        TAG, "Failed to map partition %s", label);
+
+    int animations = 0;
+    size_t offset = 0;
+
+    while (offset < partition->size && rgif2_check((const uint8_t *)data + offset, partition->size - offset) == ESP_OK) {
+        animations++;
+        offset = rgif2_pack_next(data, offset);
+    }
+
+    if (animations == 0) {
+        ESP_LOGI(TAG, "No animations in partition %s", label);
+        esp_partition_munmap(handle);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    ESP_LOGI(TAG, "%d animations in partition %s, %u KB", animations, label, offset / 1024);
+
+    pack = data;
+    pack_size = partition->size;
+    pack_offset = 0;
+    count = animations;
+
+    return ESP_OK;
+}
+
+void playlist_start()
+{
+    xTaskCreatePinnedToCore(loader_task_func, "Playlist loader", 6144, NULL, 2, &loader_task, LOADER_CORE);
+}
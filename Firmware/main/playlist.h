@@ -3,4 +3,14 @@
 #include "freertos/FreeRTOS.h"
 
 void playlist_init(const char *path);
-void playlist_next();
\ No newline at end of file
+
+// Plays the animation pack in the given flash partition instead of a
+// directory, see rgif2.h
+esp_err_t playlist_init_partition(const char *label);
+
+// Starts the task that loads the next animation ahead of time
+void playlist_start();
+
+// Switches to the animation loaded ahead of time, or to the next one as
+// soon as it is loaded. Never blocks.
+void playlist_next();
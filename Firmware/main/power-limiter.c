@@ -0,0 +1,91 @@
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+
+#include "app-config.h"
+#include "hardware.h"
+#include "power-limiter.h"
+
+static const char *TAG = "power";
+
+// The scale recovers towards the target by 1/2^RELEASE_SHIFT of the
+// difference per column
+#define RELEASE_SHIFT 4
+
+#define REPORT_INTERVAL_US 10000000
+
+typedef struct {
+    uint32_t columns;          // columns seen
+    uint32_t limited_columns;  // columns that had to be dimmed
+    uint32_t limit_events;     // transitions from unlimited to limited
+    int min_scale;             // lowest scale applied since the last report
+    int peak_ma;               // highest estimated draw before limiting
+} power_limiter_stats;
+
+static int scale = POWER_LIMITER_FULL_SCALE;
+static power_limiter_stats stats = { .min_scale = POWER_LIMITER_FULL_SCALE };
+static int64_t last_report;
+
+void power_limiter_update(int column_ma)
+{
+    int budget = global_app_config->power_budget_ma;
+    int target = POWER_LIMITER_FULL_SCALE;
+
+    stats.columns++;
+
+    if (column_ma > stats.peak_ma)
+        stats.peak_ma = column_ma;
+
+    if (budget > 0) {
+        int idle = 0;
+
+        for (int i = 0; i < MAX_ARMS; i++)
+            if (led_strip[i] != NULL)
+                idle += global_app_config->arm[i].num_leds * LED_IDLE_MA;
+
+        int available = budget > idle ? budget - idle : 0;
+
+        if (column_ma > available)
+            target = available * POWER_LIMITER_FULL_SCALE / column_ma;
+    }
+
+    if (target < scale) {
+        // Never let a column go out over budget
+        if (scale == POWER_LIMITER_FULL_SCALE)
+            stats.limit_events++;
+
+        scale = target;
+    } else if (target > scale) {
+        int step = (target - scale) >> RELEASE_SHIFT;
+        scale += step > 0 ? step : 1;
+    }
+
+    if (scale < POWER_LIMITER_FULL_SCALE)
+        stats.limited_columns++;
+
+    if (scale < stats.min_scale)
+        stats.min_scale = scale;
+}
+
+int power_limiter_scale()
+{
+    return scale;
+}
+
+void power_limiter_report(int64_t now)
+{
+    if (now - last_report < REPORT_INTERVAL_US)
+        return;
+
+    last_report = now;
+
+    if (stats.limited_columns > 0)
+        ESP_LOGI(TAG, "Limited %lu of %lu columns (%lu times), peak %d mA, budget %d mA, lowest scale %d/256",
+                 stats.limited_columns, stats.columns, stats.limit_events, stats.peak_ma,
+                 global_app_config->power_budget_ma, stats.min_scale);
+
+    stats.columns = 0;
+    stats.limited_columns = 0;
+    stats.limit_events = 0;
+    stats.peak_ma = 0;
+    stats.min_scale = scale;
+}
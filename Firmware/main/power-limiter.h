@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+
+// Keeps the estimated current of the LEDs under the configured budget
+// (app_config.power_budget_ma). The render loop reports the estimated draw
+// of every column before it goes out, and the limiter hands back a scale
+// factor for the pixels. Limiting applies immediately when a column would
+// exceed the budget, and is released gradually over the following columns,
+// so the image dims smoothly instead of flickering.
+
+// Scale factors are in 1/256, so 256 means no limiting
+#define POWER_LIMITER_FULL_SCALE 256
+
+// Estimated draw of one fully lit colour channel of one LED
+#define LED_CHANNEL_MA 20
+
+// Quiescent draw of one LED, even when it is dark
+#define LED_IDLE_MA 1
+
+// Converts a sum of channel values (after colour correction) to an
+// estimated current, in milliamps
+static inline int power_limiter_load_to_ma(uint32_t load)
+{
+    return load * LED_CHANNEL_MA / 255;
+}
+
+// Reports the estimated draw of the next column, over all arms, in
+// milliamps, and updates the scale factor accordingly
+void power_limiter_update(int column_ma);
+
+// Current scale factor, see POWER_LIMITER_FULL_SCALE
+int power_limiter_scale();
+
+// Logs the counters every now and then, if anything was limited
+void power_limiter_report(int64_t now);
@@ -0,0 +1,157 @@
+#include <stdlib.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+#include "app-config.h"
+#include "hardware.h"
+#include "hall-tracker.h"
+#include "render-latency.h"
+
+static const char *TAG = "latency";
+
+// Initial estimate before anything has been measured: 32 LEDs at 30 us
+// per LED plus the reset code
+#define DEFAULT_LATENCY_US 1250
+
+// The estimate follows new samples with a weight of 1/2^LATENCY_EMA_SHIFT
+#define LATENCY_EMA_SHIFT 3
+
+#define REPORT_INTERVAL_US 2000000
+
+// With double-buffered strips there are at most two columns in flight per
+// arm, so the start times are kept in a ring of two, indexed by sequence.
+// The render task only advances `started` and the refresh callback only
+// advances `done`. Everything is shared between the two, on different
+// cores, so it is only touched with the lock held.
+typedef struct {
+    int64_t start[2];
+    uint32_t started;
+    uint32_t done;
+    bool resync;   // a refresh went missing, the columns in flight are dropped
+    int estimate;  // in microseconds
+    int min;
+    int max;
+} arm_latency;
+
+static arm_latency latency[MAX_ARMS];
+static portMUX_TYPE latency_lock = portMUX_INITIALIZER_UNLOCKED;
+static int64_t last_report;
+
+static bool IRAM_ATTR render_latency_done(led_strip_handle_t strip, void *user_ctx)
+{
+    arm_latency *l = (arm_latency *)user_ctx;
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL_ISR(&latency_lock);
+
+    // Refreshes that didn't come from the render loop, e.g. patterns
+    if (l->done == l->started) {
+        portEXIT_CRITICAL_ISR(&latency_lock);
+        return false;
+    }
+
+    // Which column this is can't be told any more, so measure again from
+    // the next one on
+    if (l->resync) {
+        l->done = l->started;
+        l->resync = false;
+        portEXIT_CRITICAL_ISR(&latency_lock);
+        return false;
+    }
+
+    int sample = now - l->start[l->done & 1];
+    l->done++;
+
+    l->estimate += (sample - l->estimate) >> LATENCY_EMA_SHIFT;
+
+    if (sample < l->min)
+        l->min = sample;
+
+    if (sample > l->max)
+        l->max = sample;
+
+    portEXIT_CRITICAL_ISR(&latency_lock);
+
+    return false;
+}
+
+void render_latency_init()
+{
+    for (int i = 0; i < MAX_ARMS; i++) {
+        latency[i].estimate = DEFAULT_LATENCY_US;
+        latency[i].min = INT32_MAX;
+        latency[i].max = 0;
+
+        if (led_strip[i] != NULL)
+            ESP_ERROR_CHECK(led_strip_rmt_register_refresh_done_callback(led_strip[i], render_latency_done, &latency[i]));
+    }
+}
+
+void render_latency_start(int arm, int64_t time_us)
+{
+    arm_latency *l = &latency[arm];
+
+    portENTER_CRITICAL(&latency_lock);
+
+    // The ring is full, so a refresh didn't call back. Leave the columns
+    // in flight to the callback to drop rather than mixing up the ring.
+    if (l->started - l->done >= 2) {
+        l->resync = true;
+    } else {
+        l->start[l->started & 1] = time_us;
+        l->started++;
+    }
+
+    portEXIT_CRITICAL(&latency_lock);
+}
+
+void render_latency_cancel(int arm)
+{
+    arm_latency *l = &latency[arm];
+
+    portENTER_CRITICAL(&latency_lock);
+
+    if (!l->resync && l->started != l->done)
+        l->started--;
+
+    portEXIT_CRITICAL(&latency_lock);
+}
+
+int render_latency_us(int arm)
+{
+    return latency[arm].estimate;
+}
+
+void render_latency_report(int64_t now)
+{
+    if (!global_app_config->latency_calibration || now - last_report < REPORT_INTERVAL_US)
+        return;
+
+    last_report = now;
+
+    int frequency = hall_tracker_current_frequency();
+
+    for (int i = 0; i < MAX_ARMS; i++) {
+        arm_latency *l = &latency[i];
+
+        if (led_strip[i] == NULL)
+            continue;
+
+        portENTER_CRITICAL(&latency_lock);
+        int estimate = l->estimate, min = l->min, max = l->max;
+        l->min = INT32_MAX;
+        l->max = 0;
+        portEXIT_CRITICAL(&latency_lock);
+
+        if (max == 0)
+            continue;
+
+        // How far the wheel turns during the latency, in tenths of a degree
+        int lag = (int)((3600LL * abs(frequency) * estimate) / 1000000000LL);
+
+        ESP_LOGI(TAG, "Arm %d: latency %d us (min %d, max %d), %d.%d degrees at %d mHz",
+                 i, estimate, min, max, lag / 10, lag % 10, frequency);
+    }
+}
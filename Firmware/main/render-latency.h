@@ -0,0 +1,23 @@
+#pragma once
+
+#include "freertos/FreeRTOS.h"
+
+// Tracks the output latency of every arm: the time from the start of
+// rendering a column until the strip has latched it, i.e. the render
+// work plus the transfer and the reset code on the wire. The render
+// loop uses it to pick the column for where the arm will be when the
+// LEDs actually change, rather than where it was when we asked.
+
+void render_latency_init();
+
+// Call right before a column is rendered into the arm's strip
+void render_latency_start(int arm, int64_t time_us);
+
+// Call if the refresh of that column failed, so it isn't waited for
+void render_latency_cancel(int arm);
+
+// Current latency estimate of an arm, in microseconds
+int render_latency_us(int arm);
+
+// Logs the measured latencies if latency calibration is enabled
+void render_latency_report(int64_t now);
@@ -0,0 +1,87 @@
+#include <string.h>
+#include "esp_log.h"
+
+#include "rgif2.h"
+
+static const char *TAG = "rgif2";
+
+static esp_err_t rgif2_check_delta(const rgif2_header *header, int frame)
+{
+    const rgif2_frame_entry *entry = &rgif2_frame_table(header)[frame];
+    size_t column_size = rgif2_column_size(header);
+    size_t offset = entry->offset;
+
+    if (frame == 0 || offset + sizeof(rgif2_delta_header) > header->file_size)
+        return ESP_ERR_INVALID_SIZE;
+
+    const rgif2_delta_header *delta = (const rgif2_delta_header *)((const uint8_t *)header + offset);
+
+    offset += sizeof(rgif2_delta_header);
+
+    for (int i = 0; i < delta->span_count; i++) {
+        const rgif2_span *span = (const rgif2_span *)((const uint8_t *)header + offset);
+
+        if (offset + sizeof(rgif2_span) > header->file_size)
+            return ESP_ERR_INVALID_SIZE;
+
+        offset += sizeof(rgif2_span) + span->columns * column_size;
+        if (span->x + span->columns > header->width || offset > header->file_size)
+            return ESP_ERR_INVALID_SIZE;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t rgif2_check(const void *data, size_t size)
+{
+    const rgif2_header *header = data;
+
+    if (size < sizeof(rgif2_header) || memcmp(header->magic, RGIF2_MAGIC, 4) != 0)
+        return ESP_ERR_NOT_FOUND;
+
+    if (header->version != RGIF2_VERSION) {
+        ESP_LOGE(TAG, "Unsupported version %d", header->version);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    if (header->bytes_per_pixel != 3 || header->pixel_format != RGIF2_FORMAT_GRB) {
+        ESP_LOGE(TAG, "Unsupported pixel format %d", header->pixel_format);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    if (header->file_size > size || header->header_size < sizeof(rgif2_header) || header->frame_count == 0 ||
+        header->frame_size != (uint32_t)header->width * header->height * header->bytes_per_pixel ||
+        header->header_size + header->frame_count * sizeof(rgif2_frame_entry) > header->file_size) {
+        ESP_LOGE(TAG, "Truncated or corrupt header");
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    const rgif2_frame_entry *frames = rgif2_frame_table(header);
+
+    for (int i = 0; i < header->frame_count; i++) {
+        bool valid;
+
+        if (frames[i].offset % RGIF2_FRAME_ALIGNMENT != 0)
+            valid = false;
+        else if (frames[i].flags & RGIF2_FRAME_DELTA)
+            valid = rgif2_check_delta(header, i) == ESP_OK;
+        else
+            valid = header->frame_size <= header->file_size &&
+                    frames[i].offset <= header->file_size - header->frame_size;
+
+        if (!valid) {
+            ESP_LOGE(TAG, "Frame %d out of bounds", i);
+            return ESP_ERR_INVALID_SIZE;
+        }
+    }
+
+    return ESP_OK;
+}
+
+size_t rgif2_pack_next(const void *pack, size_t offset)
+{
+    const rgif2_header *header = (const rgif2_header *)((const uint8_t *)pack + offset);
+    size_t end = offset + header->file_size;
+
+    return (end + RGIF2_PACK_ALIGNMENT - 1) / RGIF2_PACK_ALIGNMENT * RGIF2_PACK_ALIGNMENT;
+}
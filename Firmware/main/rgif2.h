@@ -0,0 +1,115 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+// The native .rgif2 animation container, written by the converter in
+// convert/. Frames are stored exactly the way the canvas holds them:
+// column-major, one column per step of the revolution, every pixel in
+// the GRB order the strips take on the wire. A frame can be presented
+// straight from the file, so a file that is memory-mapped from flash
+// costs neither RAM nor decoding.
+//
+// All fields are little-endian. The frame table follows the header and
+// holds the offset of every frame's pixels from the start of the file,
+// which is aligned to RGIF2_FRAME_ALIGNMENT.
+//
+// A delta frame only holds the runs of columns that changed since the
+// previous frame: a rgif2_delta_header, then every span as a rgif2_span
+// followed by its columns. The first frame is always a complete one.
+//
+// A pack is a sequence of .rgif2 files, each starting at a multiple of
+// RGIF2_PACK_ALIGNMENT, written to a raw flash partition. It ends at the
+// first offset that doesn't hold a file, usually erased flash.
+
+#define RGIF2_MAGIC "RGF2"
+#define RGIF2_VERSION 1
+
+#define RGIF2_FORMAT_GRB 0
+
+#define RGIF2_FRAME_DELTA 0x0001
+
+#define RGIF2_FRAME_ALIGNMENT 16
+#define RGIF2_PACK_ALIGNMENT 4096
+
+typedef struct __attribute__((packed)) {
+    char magic[4];
+    uint16_t version;
+    uint16_t header_size;       // offset of the frame table
+    uint32_t file_size;
+    uint16_t width;             // columns per revolution
+    uint16_t height;            // pixels per column
+    uint8_t bytes_per_pixel;
+    uint8_t pixel_format;
+    uint16_t frame_count;
+    uint32_t frame_size;        // bytes of pixels per frame
+    uint32_t reserved[2];
+} rgif2_header;
+
+typedef struct __attribute__((packed)) {
+    uint32_t offset;
+    uint16_t delay_cs;
+    uint16_t flags;
+} rgif2_frame_entry;
+
+typedef struct __attribute__((packed)) {
+    uint16_t span_count;
+    uint16_t reserved;
+} rgif2_delta_header;
+
+typedef struct __attribute__((packed)) {
+    uint16_t x;
+    uint16_t columns;
+} rgif2_span;
+
+_Static_assert(sizeof(rgif2_header) == 32, "rgif2 header layout");
+_Static_assert(sizeof(rgif2_frame_entry) == 8, "rgif2 frame table layout");
+_Static_assert(sizeof(rgif2_span) == 4, "rgif2 span layout");
+
+// Checks that `size` bytes at `data` hold a complete, well-formed file
+esp_err_t rgif2_check(const void *data, size_t size);
+
+static inline const rgif2_frame_entry *rgif2_frame_table(const rgif2_header *header)
+{
+    return (const rgif2_frame_entry *)((const uint8_t *)header + header->header_size);
+}
+
+static inline const uint8_t *rgif2_frame_pixels(const rgif2_header *header, int frame)
+{
+    return (const uint8_t *)header + rgif2_frame_table(header)[frame].offset;
+}
+
+static inline bool rgif2_frame_is_delta(const rgif2_header *header, int frame)
+{
+    return (rgif2_frame_table(header)[frame].flags & RGIF2_FRAME_DELTA) != 0;
+}
+
+static inline size_t rgif2_column_size(const rgif2_header *header)
+{
+    return header->height * header->bytes_per_pixel;
+}
+
+// Calls `apply` for every span of a delta frame, with the pixels of its
+// columns. Delta frames must have passed rgif2_check().
+static inline void rgif2_delta_for_each(const rgif2_header *header, int frame,
+                                        void (*apply)(int x, int columns, const uint8_t *pixels))
+{
+    const uint8_t *data = rgif2_frame_pixels(header, frame);
+    const rgif2_delta_header *delta = (const rgif2_delta_header *)data;
+
+    data += sizeof(rgif2_delta_header);
+
+    for (int i = 0; i < delta->span_count; i++) {
+        const rgif2_span *span = (const rgif2_span *)data;
+
+        data += sizeof(rgif2_span);
+        apply(span->x, span->columns, data);
+        data += span->columns * rgif2_column_size(header);
+    }
+}
+
+// Offset of the file that follows the one at `offset` in a pack, which
+// must have passed rgif2_check()
+size_t rgif2_pack_next(const void *pack, size_t offset);
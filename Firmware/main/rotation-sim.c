@@ -0,0 +1,131 @@
+#include <math.h>
+
+#include "rotation-sim.h"
+
+// Integration step, in microseconds
+#define STEP_US 100
+
+// Give up looking for an edge after this long at standstill
+#define MAX_SEARCH_US 10000000
+
+static float rotation_sim_random(rotation_sim *sim)
+{
+    // xorshift32, returns [0, 1)
+    uint32_t x = sim->random;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    sim->random = x;
+
+    return (x >> 8) / 16777216.0f;
+}
+
+void rotation_sim_init(rotation_sim *sim, const rotation_sim_config *config)
+{
+    sim->config = *config;
+    sim->time = 0;
+    sim->position = 0;
+    sim->speed = 0;
+    sim->segment = 0;
+    sim->segment_start = 0;
+    sim->segment_start_speed = 0;
+    sim->random = config->seed != 0 ? config->seed : 1;
+    sim->bounce_pending = false;
+}
+
+// Speed the profile asks for at the current time
+static float rotation_sim_profile_speed(rotation_sim *sim)
+{
+    const rotation_sim_config *config = &sim->config;
+
+    while (sim->segment < config->num_segments) {
+        const rotation_sim_segment *segment = &config->segments[sim->segment];
+        int64_t elapsed = sim->time - sim->segment_start;
+        int64_t duration = (int64_t)segment->duration_ms * 1000;
+
+        if (elapsed < duration)
+            return sim->segment_start_speed + (segment->speed - sim->segment_start_speed) * elapsed / duration;
+
+        sim->segment_start += duration;
+        sim->segment_start_speed = segment->speed;
+        sim->segment++;
+
+        if (sim->segment == config->num_segments && config->loop)
+            sim->segment = 0;
+    }
+
+    return sim->segment_start_speed;
+}
+
+double rotation_sim_position(const rotation_sim *sim)
+{
+    return sim->position;
+}
+
+bool rotation_sim_next_edge(rotation_sim *sim, int *sensor, int64_t *timestamp)
+{
+    const rotation_sim_config *config = &sim->config;
+    int64_t search_end = sim->time + MAX_SEARCH_US;
+
+    while (sim->time < search_end) {
+        float speed = rotation_sim_profile_speed(sim);
+        double fraction = sim->position - floor(sim->position);
+
+        speed *= 1.0f + config->wobble * sinf(2.0f * (float)M_PI * fraction);
+
+        double from = sim->position;
+        double to = from + speed * STEP_US * 1e-6;
+        int crossed = -1;
+        double crossing = 0;
+
+        sim->speed = speed;
+
+        // Did the wheel pass a sensor during this step?
+        for (int i = 0; i < config->num_sensors; i++) {
+            double p = config->sensor_positions[i];
+
+            if (floor(from - p) != floor(to - p)) {
+                crossed = i;
+                crossing = (floor(fmax(from, to) - p) + p - from) / (to - from);
+                break;
+            }
+        }
+
+        // A pending bounce goes out first if it is due
+        if (sim->bounce_pending && (crossed < 0 || sim->bounce_time <= sim->time + crossing * STEP_US)
+            && sim->bounce_time <= sim->time + STEP_US) {
+            sim->bounce_pending = false;
+            *sensor = sim->bounce_sensor;
+            *timestamp = sim->bounce_time;
+            return true;
+        }
+
+        if (crossed < 0) {
+            sim->position = to;
+            sim->time += STEP_US;
+            continue;
+        }
+
+        // Stop right behind the sensor so the next call carries on from there
+        int64_t edge = sim->time + (int64_t)(crossing * STEP_US);
+
+        sim->position = from + (to - from) * crossing + (to > from ? 1e-9 : -1e-9);
+        sim->time = edge;
+
+        if (rotation_sim_random(sim) < config->dropout)
+            continue;
+
+        if (rotation_sim_random(sim) < config->bounce) {
+            sim->bounce_pending = true;
+            sim->bounce_sensor = crossed;
+            sim->bounce_time = edge + 1 + (int64_t)(rotation_sim_random(sim) * config->bounce_us);
+        }
+
+        *sensor = crossed;
+        *timestamp = edge + (int64_t)((rotation_sim_random(sim) * 2.0f - 1.0f) * config->jitter_us);
+        return true;
+    }
+
+    return false;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Generates the hall sensor edges of a simulated wheel, so the tracker and
+// the render path can be exercised without anything spinning. The wheel
+// follows a speed profile of linear ramps. On top of that it can wobble
+// once per revolution, and the edges can be jittered, dropped or followed
+// by a bounce, the way real sensors misbehave.
+//
+// Positions are in revolutions and times in microseconds, like in
+// angle-estimator.h. The code has no dependencies on the ESP-IDF. In the
+// host build, host/rotation-sim-test.c drives the tracker with it.
+
+#define ROTATION_SIM_MAX_SENSORS 8
+
+typedef struct {
+    int duration_ms;
+    float speed;  // at the end of the segment, in revolutions per second
+} rotation_sim_segment;
+
+typedef struct {
+    const rotation_sim_segment *segments;
+    int num_segments;
+    bool loop;  // start over at the end of the profile, otherwise keep the last speed
+
+    float sensor_positions[ROTATION_SIM_MAX_SENSORS];
+    int num_sensors;
+
+    float jitter_us;  // edges are moved by up to this much either way
+    float dropout;    // probability of an edge going missing
+    float bounce;     // probability of an edge being followed by a spurious one
+    int bounce_us;    // longest delay of a spurious edge
+    float wobble;     // speed modulation once per revolution, relative to the speed
+    uint32_t seed;
+} rotation_sim_config;
+
+typedef struct {
+    rotation_sim_config config;
+    int64_t time;     // of the simulation, in microseconds
+    double position;  // in revolutions, not wrapped
+    float speed;      // in revolutions per second
+    int segment;
+    int64_t segment_start;
+    float segment_start_speed;
+    uint32_t random;
+
+    // A bounce that is due after the next real edge
+    bool bounce_pending;
+    int bounce_sensor;
+    int64_t bounce_time;
+} rotation_sim;
+
+void rotation_sim_init(rotation_sim *sim, const rotation_sim_config *config);
+
+// Runs the simulation up to the next edge and returns it. Returns false if
+// the profile has ended without any more edges.
+bool rotation_sim_next_edge(rotation_sim *sim, int *sensor, int64_t *timestamp);
+
+// True position of the wheel at the current simulation time
+double rotation_sim_position(const rotation_sim *sim);
@@ -0,0 +1,212 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "nvs.h"
+
+#include "app-config.h"
+#include "sensor-calibration.h"
+#include "utils.h"
+
+static const char *TAG = "calibration";
+
+#define NVS_NAMESPACE "spokespice"
+#define NVS_KEY "arm_offsets"
+
+#define REFERENCE_SENSOR 0
+
+// Revolutions to average over, per sensor
+#define CALIBRATION_SAMPLES 100
+
+// Samples left out at either end, so stray edges that made it through the
+// tracker's filter don't end up in the stored offsets
+#define CALIBRATION_TRIM (CALIBRATION_SAMPLES / 4)
+
+// Revolutions whose period differs from the previous one by more than
+// 1/STEADY_TOLERANCE are not used
+#define STEADY_TOLERANCE 100
+
+static volatile bool running;
+
+static int64_t reference_time;
+static int64_t period;
+static bool steady;
+
+static int16_t samples[MAX_ARMS][CALIBRATION_SAMPLES];
+static int counts[MAX_ARMS];
+
+static esp_err_t sensor_calibration_load(int16_t *offsets)
+{
+    nvs_handle_t handle;
+    size_t size = MAX_ARMS * sizeof(int16_t);
+
+    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle);
+    if (ret != ESP_OK)
+        return ret;
+
+    ret = nvs_get_blob(handle, NVS_KEY, offsets, &size);
+    nvs_close(handle);
+
+    if (ret == ESP_OK && size != MAX_ARMS * sizeof(int16_t))
+        ret = ESP_ERR_INVALID_SIZE;
+
+    return ret;
+}
+
+static esp_err_t sensor_calibration_save(const int16_t *offsets)
+{
+    nvs_handle_t handle;
+
+    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (ret != ESP_OK)
+        return ret;
+
+    ret = nvs_set_blob(handle, NVS_KEY, offsets, MAX_ARMS * sizeof(int16_t));
+    if (ret == ESP_OK)
+        ret = nvs_commit(handle);
+
+    nvs_close(handle);
+
+    return ret;
+}
+
+void sensor_calibration_init()
+{
+    int16_t offsets[MAX_ARMS];
+
+    if (sensor_calibration_load(offsets) == ESP_OK) {
+        for (int i = 0; i < MAX_ARMS; i++) {
+            global_app_config->arm[i].phase_offset = offsets[i];
+            ESP_LOGI(TAG, "Arm %d: sensor offset %d/65536", i, offsets[i]);
+        }
+    } else {
+        ESP_LOGI(TAG, "No stored sensor offsets");
+        sensor_calibration_start();
+        return;
+    }
+
+    if (global_app_config->calibrate_sensors)
+        sensor_calibration_start();
+}
+
+void sensor_calibration_start()
+{
+    reference_time = 0;
+    period = 0;
+    steady = false;
+
+    memset(counts, 0, sizeof(counts));
+
+    running = true;
+
+    ESP_LOGI(TAG, "Calibrating sensor offsets, waiting for a steady speed");
+}
+
+bool sensor_calibration_running()
+{
+    return running;
+}
+
+static bool sensor_calibration_complete()
+{
+    for (int i = 0; i < MAX_ARMS; i++) {
+        if (i == REFERENCE_SENSOR || global_app_config->arm[i].hall_sensor_pin < 0)
+            continue;
+
+        if (counts[i] < CALIBRATION_SAMPLES)
+            return false;
+    }
+
+    return true;
+}
+
+static int compare_samples(const void *a, const void *b)
+{
+    return *(const int16_t *)a - *(const int16_t *)b;
+}
+
+// Mean of the samples of a sensor, without the highest and lowest
+static int16_t sensor_calibration_offset(int sensor)
+{
+    int16_t *s = samples[sensor];
+    int32_t sum = 0;
+
+    qsort(s, CALIBRATION_SAMPLES, sizeof(s[0]), compare_samples);
+
+    for (int i = CALIBRATION_TRIM; i < CALIBRATION_SAMPLES - CALIBRATION_TRIM; i++)
+        sum += s[i];
+
+    return sum / (CALIBRATION_SAMPLES - 2 * CALIBRATION_TRIM);
+}
+
+// Writing to flash takes a while, so it's kept out of the tracker task
+static void sensor_calibration_save_task_func(void *arg)
+{
+    int16_t *offsets = arg;
+
+    esp_err_t ret = sensor_calibration_save(offsets);
+    if (ret != ESP_OK)
+        ESP_LOGE(TAG, "Failed to store sensor offsets: %s", esp_err_to_name(ret));
+
+    free(offsets);
+    vTaskDelete(NULL);
+}
+
+static void sensor_calibration_finish()
+{
+    int16_t *offsets = calloc(MAX_ARMS, sizeof(int16_t));
+
+    running = false;
+
+    if (offsets == NULL) {
+        ESP_LOGE(TAG, "Out of memory for the sensor offsets");
+        return;
+    }
+
+    for (int i = 0; i < MAX_ARMS; i++) {
+        if (counts[i] == CALIBRATION_SAMPLES)
+            offsets[i] = sensor_calibration_offset(i);
+
+        global_app_config->arm[i].phase_offset = offsets[i];
+
+        ESP_LOGI(TAG, "Arm %d: sensor offset %d/65536 (%d.%d degrees)", i, offsets[i],
+                 offsets[i] * 360 / PHASE_FULL, abs(offsets[i] * 3600 / PHASE_FULL) % 10);
+    }
+
+    if (xTaskCreate(sensor_calibration_save_task_func, "Calibration save", 3072, offsets, 1, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start storing the sensor offsets");
+        free(offsets);
+    }
+}
+
+void sensor_calibration_feed(int sensor, int64_t timestamp)
+{
+    if (sensor == REFERENCE_SENSOR) {
+        if (reference_time > 0) {
+            int64_t p = timestamp - reference_time;
+
+            steady = period > 0 && llabs(p - period) * STEADY_TOLERANCE < period;
+            period = p;
+        }
+
+        reference_time = timestamp;
+        return;
+    }
+
+    if (!steady || timestamp - reference_time >= period)
+        return;
+
+    // The phase runs down while the wheel turns, so the sensor sits that
+    // fraction of a revolution behind the reference
+    phase_t elapsed = ((timestamp - reference_time) * PHASE_FULL) / period;
+    phase_t reference = phase_from_degrees(global_app_config->arm[REFERENCE_SENSOR].angle);
+    phase_t nominal = phase_from_degrees(global_app_config->arm[sensor].angle);
+
+    if (counts[sensor] < CALIBRATION_SAMPLES)
+        samples[sensor][counts[sensor]++] = (int16_t)(phase_t)(reference - elapsed - nominal);
+
+    if (sensor_calibration_complete())
+        sensor_calibration_finish();
+}
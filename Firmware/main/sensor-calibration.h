@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Learns how far every hall sensor is off its nominal angle. Magnets and
+// sensors are never mounted exactly, which makes the images on the arms
+// drift apart. Once the wheel turns at a steady speed, the time from the
+// edge of the first sensor to the edges of the others, as a fraction of a
+// revolution, gives their real angles. The differences to the configured
+// angles are averaged over a number of revolutions, leaving out the
+// highest and lowest quarter, stored in NVS and applied as the arms'
+// `phase_offset`.
+//
+// The first arm's sensor is the reference and keeps an offset of zero;
+// aligning the image as a whole is what `angle_offset` is for.
+
+// Loads stored offsets, and arms the calibration if there are none or if
+// app_config.calibrate_sensors is set
+void sensor_calibration_init();
+
+// Starts learning the offsets from scratch
+void sensor_calibration_start();
+
+bool sensor_calibration_running();
+
+// Feeds a sensor edge the hall tracker's filter accepted. Called from the
+// hall tracker task. The result is stored to NVS from a task of its own,
+// so the flash write doesn't hold up the edges.
+void sensor_calibration_feed(int sensor, int64_t timestamp);
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <stdint.h>
+
 static inline int angle_normalize(int input) {
     int output = input;
 
@@ -8,4 +10,24 @@ static inline int angle_normalize(int input) {
     }
  
     return output % 360;
-}
\ No newline at end of file
+}
+
+// The wheel phase is a fixed-point fraction of a revolution, in units of
+// 1/65536 turn. Being a uint16_t, it wraps around by itself.
+typedef uint16_t phase_t;
+
+#define PHASE_BITS 16
+#define PHASE_FULL (1 << PHASE_BITS)
+
+static inline phase_t phase_from_degrees(int degrees) {
+    return (phase_t)(((int64_t)degrees * PHASE_FULL) / 360);
+}
+
+static inline int phase_to_degrees(phase_t phase) {
+    return ((uint32_t)phase * 360) >> PHASE_BITS;
+}
+
+// Maps a phase to one of `width` columns
+static inline int phase_to_column(phase_t phase, int width) {
+    return ((uint32_t)phase * width) >> PHASE_BITS;
+}
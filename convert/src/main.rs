@@ -1,30 +1,59 @@
+mod rgif2;
+
 use gif::{Encoder, Frame};
 use std::fs::File;
 use std::cmp;
 use std::io;
 use std::io::Write;
 
-const OUTPUT_WIDTH: u16 = 360;
+// Columns per revolution. The firmware only plays .rgif2 files converted
+// for its canvas width (CONFIG_SPOKESPICE_CANVAS_WIDTH), see --width.
+const DEFAULT_OUTPUT_WIDTH: u16 = 360;
 const OUTPUT_HEIGHT: u16 = 32;
-const DEG_OVERSAMPLING: u16 = 10;
+const COLUMN_OVERSAMPLING: u16 = 10;
 
 // The center offset is the number of LEDs that are missing in the center of the output.
 const CENTER_OFFSET: u16 = 3;
 const OUTPUT_STEPS: u16 = OUTPUT_HEIGHT + CENTER_OFFSET;
 
 fn main() -> Result<(), Box<dyn std::error::Error>> {
-    let input_path = std::env::args().nth(1).expect("no input file given");
-    let output_path = std::env::args().nth(2).expect("no output file given");
+    let mut args: Vec<String> = std::env::args().collect();
+
+    if args.get(1).map(String::as_str) == Some("--pack") {
+        let output_path = args.get(2).expect("no output file given");
+        return rgif2::write_pack(output_path, &args[3..]);
+    }
+
+    let mut width = DEFAULT_OUTPUT_WIDTH;
+
+    if args.get(1).map(String::as_str) == Some("--width") {
+        width = args
+            .get(2)
+            .and_then(|value| value.parse().ok())
+            .filter(|&value| value > 0)
+            .expect("--width needs a number of columns");
+        args.drain(1..3);
+    }
+
+    let input_path = args.get(1).expect("no input file given");
+    let output_path = args.get(2).expect("no output file given");
+
+    // Native column-major output for the firmware, or a GIF
+    let native = output_path.ends_with(".rgif2");
 
     let input = File::open(input_path).unwrap();
     let mut options = gif::DecodeOptions::new();
     options.set_color_output(gif::ColorOutput::RGBA);
     let mut decoder = options.read_info(input).unwrap();
 
-    let palette = decoder.palette().unwrap();
-
     let mut output = File::create(output_path).unwrap();
-    let mut encoder = Encoder::new(&mut output, OUTPUT_WIDTH, OUTPUT_HEIGHT, palette).unwrap();
+    let mut encoder = if native {
+        None
+    } else {
+        let palette = decoder.palette().unwrap();
+        Some(Encoder::new(&mut output, width, OUTPUT_HEIGHT, palette).unwrap())
+    };
+    let mut native_frames = Vec::new();
 
     let mut count = 0;
 
@@ -34,22 +63,57 @@ fn main() -> Result<(), Box<dyn std::error::Error>> {
         print!("Processing frame {} ...\r", count);
         io::stdout().flush().unwrap();
 
-        let new_frame = process_frame(&frame)?;
-        encoder.write_frame(&new_frame).unwrap();
+        match encoder.as_mut() {
+            Some(encoder) => encoder.write_frame(&process_frame(&frame, width)?).unwrap(),
+            None => native_frames.push(rgif2::Frame {
+                rgba: render_frame(&frame, width),
+                delay_cs: frame.delay,
+            }),
+        }
     }
 
+    drop(encoder);
     print!("Processed {} frame(s)        \n", count);
 
+    if native {
+        let (data, stats) = rgif2::encode(width, OUTPUT_HEIGHT, &native_frames);
+
+        output.write_all(&data)?;
+        println!(
+            "{} of {} frame(s) as deltas, {} KB of {} KB, ratio {:.2}",
+            stats.delta_frames,
+            stats.frames,
+            stats.encoded_size / 1024,
+            stats.raw_size / 1024,
+            stats.raw_size as f64 / stats.encoded_size as f64
+        );
+    }
+
     Ok(())
 }
 
-fn process_frame(frame: &gif::Frame) -> Result<Frame<'static>, gif::EncodingError> {
-    let mut output_buffer = vec![0; OUTPUT_WIDTH as usize * OUTPUT_HEIGHT as usize * 4];
+fn process_frame(frame: &gif::Frame, width: u16) -> Result<Frame<'static>, gif::EncodingError> {
+    let mut output_buffer = render_frame(frame, width);
+    let mut new_frame = gif::Frame::from_rgba(width, OUTPUT_HEIGHT, &mut output_buffer);
+
+    // // Preserve other frame properties
+    new_frame.delay = frame.delay;
+    new_frame.dispose = frame.dispose;
+    new_frame.transparent = frame.transparent;
+
+    Ok(new_frame)
+}
+
+// Samples the frame along a ray per output column, the innermost LED in
+// the first row
+fn render_frame(frame: &gif::Frame, width: u16) -> Vec<u8> {
+    let mut output_buffer = vec![0; width as usize * OUTPUT_HEIGHT as usize * 4];
+    let column_degrees = 360.0 / width as f32;
 
     let (center_x, center_y) = (frame.width / 2, frame.height / 2);
     let vector_length = cmp::min(center_x, center_y);
 
-    for deg in 0..OUTPUT_WIDTH {
+    for column in 0..width {
         let mut r = 0;
         let mut g = 0;
         let mut b = 0;
@@ -57,10 +121,10 @@ fn process_frame(frame: &gif::Frame) -> Result<Frame<'static>, gif::EncodingErro
         let mut current_output_y = 0;
 
         // Iterate over all pixels along the way of the vector and average their colors.
-        // Oversample by the factor of DEG_OVERSAMPLING to get a smoother output.
+        // Oversample by the factor of COLUMN_OVERSAMPLING to get a smoother output.
         for i in 0..vector_length {
-            for sub in 0..DEG_OVERSAMPLING {
-                let a = deg as f32 + (sub as f32 / DEG_OVERSAMPLING as f32);
+            for sub in 0..COLUMN_OVERSAMPLING {
+                let a = (column as f32 + sub as f32 / COLUMN_OVERSAMPLING as f32) * column_degrees;
                 let x: u32 = (center_x as f32 + i as f32 * a.to_radians().cos()).round() as u32;
                 let y: u32 = (center_y as f32 + i as f32 * a.to_radians().sin()).round() as u32;
    
@@ -79,7 +143,7 @@ fn process_frame(frame: &gif::Frame) -> Result<Frame<'static>, gif::EncodingErro
                     continue;
                 }
 
-                let index = ((current_output_y - CENTER_OFFSET - 1) * OUTPUT_WIDTH + deg) as usize * 4;
+                let index = ((current_output_y - CENTER_OFFSET - 1) as usize * width as usize + column as usize) * 4;
 
                 output_buffer[index + 0] = (r / count) as u8;
                 output_buffer[index + 1] = (g / count) as u8;
@@ -94,12 +158,5 @@ fn process_frame(frame: &gif::Frame) -> Result<Frame<'static>, gif::EncodingErro
         }
     }
 
-    let mut new_frame = gif::Frame::from_rgba(OUTPUT_WIDTH, OUTPUT_HEIGHT, &mut output_buffer);
-
-    // // Preserve other frame properties
-    new_frame.delay = frame.delay;
-    new_frame.dispose = frame.dispose;
-    new_frame.transparent = frame.transparent;
-
-    Ok(new_frame)
+    output_buffer
 }
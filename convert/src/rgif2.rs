@@ -0,0 +1,184 @@
+// Writer for the native .rgif2 container, see Firmware/main/rgif2.h for
+// the layout. Frames are stored column-major in GRB order, the way the
+// firmware's canvas holds them, so they can be played straight from flash.
+// Frames that only change some columns are stored as delta frames.
+
+use std::fs::File;
+use std::io::{Read, Write};
+
+const MAGIC: &[u8; 4] = b"RGF2";
+const VERSION: u16 = 1;
+const HEADER_SIZE: usize = 32;
+const FRAME_ENTRY_SIZE: usize = 8;
+const FORMAT_GRB: u8 = 0;
+const BYTES_PER_PIXEL: usize = 3;
+
+const FRAME_DELTA: u16 = 0x0001;
+
+const FRAME_ALIGNMENT: usize = 16;
+const PACK_ALIGNMENT: usize = 4096;
+
+pub struct Frame {
+    // Row-major RGBA, one row per LED and one column per step of the revolution
+    pub rgba: Vec<u8>,
+    pub delay_cs: u16,
+}
+
+fn align(n: usize, alignment: usize) -> usize {
+    (n + alignment - 1) / alignment * alignment
+}
+
+fn to_columns(rgba: &[u8], width: usize, height: usize) -> Vec<u8> {
+    let mut columns = Vec::with_capacity(width * height * BYTES_PER_PIXEL);
+
+    for x in 0..width {
+        for y in 0..height {
+            let pixel = &rgba[(y * width + x) * 4..];
+
+            columns.extend_from_slice(&[pixel[1], pixel[0], pixel[2]]);
+        }
+    }
+
+    columns
+}
+
+// The runs of columns that differ between two frames, as a delta frame
+fn encode_delta(previous: &[u8], current: &[u8], column_size: usize) -> Vec<u8> {
+    let changed: Vec<bool> = previous
+        .chunks(column_size)
+        .zip(current.chunks(column_size))
+        .map(|(a, b)| a != b)
+        .collect();
+    let mut spans = Vec::new();
+    let mut x = 0;
+
+    while x < changed.len() {
+        if !changed[x] {
+            x += 1;
+            continue;
+        }
+
+        let start = x;
+        while x < changed.len() && changed[x] {
+            x += 1;
+        }
+
+        spans.push((start, x - start));
+    }
+
+    let mut out = Vec::new();
+
+    out.extend_from_slice(&(spans.len() as u16).to_le_bytes());
+    out.extend_from_slice(&0u16.to_le_bytes());
+
+    for (x, columns) in spans {
+        out.extend_from_slice(&(x as u16).to_le_bytes());
+        out.extend_from_slice(&(columns as u16).to_le_bytes());
+        out.extend_from_slice(&current[x * column_size..(x + columns) * column_size]);
+    }
+
+    out
+}
+
+pub struct Stats {
+    pub frames: usize,
+    pub delta_frames: usize,
+    // Size of the frames if all of them were stored complete, and as encoded
+    pub raw_size: usize,
+    pub encoded_size: usize,
+}
+
+pub fn encode(width: u16, height: u16, frames: &[Frame]) -> (Vec<u8>, Stats) {
+    assert!(!frames.is_empty() && frames.len() <= u16::MAX as usize, "unsupported frame count");
+
+    let frame_size = width as usize * height as usize * BYTES_PER_PIXEL;
+    let column_size = height as usize * BYTES_PER_PIXEL;
+    let columns: Vec<Vec<u8>> = frames
+        .iter()
+        .map(|frame| to_columns(&frame.rgba, width as usize, height as usize))
+        .collect();
+
+    // The first frame is always complete, the others are stored as deltas
+    // to the previous frame when that is smaller
+    let mut stats = Stats { frames: frames.len(), delta_frames: 0, raw_size: frames.len() * frame_size, encoded_size: 0 };
+    let mut blobs: Vec<(Vec<u8>, u16)> = Vec::with_capacity(frames.len());
+
+    for i in 0..frames.len() {
+        if i > 0 {
+            let delta = encode_delta(&columns[i - 1], &columns[i], column_size);
+
+            if delta.len() < frame_size {
+                stats.delta_frames += 1;
+                stats.encoded_size += delta.len();
+                blobs.push((delta, FRAME_DELTA));
+                continue;
+            }
+        }
+
+        stats.encoded_size += frame_size;
+        blobs.push((columns[i].clone(), 0));
+    }
+
+    let first_frame = align(HEADER_SIZE + frames.len() * FRAME_ENTRY_SIZE, FRAME_ALIGNMENT);
+    let mut offsets = Vec::with_capacity(frames.len());
+    let mut file_size = first_frame;
+
+    for (blob, _) in &blobs {
+        offsets.push(file_size);
+        file_size = align(file_size + blob.len(), FRAME_ALIGNMENT);
+    }
+
+    let mut out = Vec::with_capacity(file_size);
+
+    out.extend_from_slice(MAGIC);
+    out.extend_from_slice(&VERSION.to_le_bytes());
+    out.extend_from_slice(&(HEADER_SIZE as u16).to_le_bytes());
+    out.extend_from_slice(&(file_size as u32).to_le_bytes());
+    out.extend_from_slice(&width.to_le_bytes());
+    out.extend_from_slice(&height.to_le_bytes());
+    out.push(BYTES_PER_PIXEL as u8);
+    out.push(FORMAT_GRB);
+    out.extend_from_slice(&(frames.len() as u16).to_le_bytes());
+    out.extend_from_slice(&(frame_size as u32).to_le_bytes());
+    out.resize(HEADER_SIZE, 0);
+
+    for ((frame, offset), (_, flags)) in frames.iter().zip(&offsets).zip(&blobs) {
+        out.extend_from_slice(&(*offset as u32).to_le_bytes());
+        out.extend_from_slice(&frame.delay_cs.to_le_bytes());
+        out.extend_from_slice(&flags.to_le_bytes());
+    }
+
+    for (blob, _) in &blobs {
+        out.resize(align(out.len(), FRAME_ALIGNMENT), 0);
+        out.extend_from_slice(blob);
+    }
+
+    out.resize(file_size, 0);
+    (out, stats)
+}
+
+// Concatenates .rgif2 files into an image for the firmware's animation
+// partition, each file starting on a flash sector
+pub fn write_pack(output_path: &str, input_paths: &[String]) -> Result<(), Box<dyn std::error::Error>> {
+    let mut pack = Vec::new();
+
+    for path in input_paths {
+        let mut data = Vec::new();
+
+        File::open(path)?.read_to_end(&mut data)?;
+        if data.len() < HEADER_SIZE || &data[0..4] != MAGIC {
+            return Err(format!("{} is not an .rgif2 file", path).into());
+        }
+
+        pack.resize(align(pack.len(), PACK_ALIGNMENT), 0xff);
+        pack.extend_from_slice(&data);
+    }
+
+    // Erased flash after the last file ends the pack
+    pack.resize(align(pack.len(), PACK_ALIGNMENT), 0xff);
+    File::create(output_path)?.write_all(&pack)?;
+
+    println!("Packed {} file(s), {} KB", input_paths.len(), pack.len() / 1024);
+
+    Ok(())
+}